@@ -0,0 +1,28 @@
+#include <nokiaLCD.h>
+#include <nokiaConsole.h>
+
+// pins are in this order: reset, dc (d/c), sdin (mosi - data in), sclk (sck - clock), sce (chip enable), led (backlight)
+nokiaLCD display(10,11,12,13,7,6);
+nokiaConsole console(display);
+
+void setup(void)
+{
+  display.init();
+  display.clear();
+  display.backlight(true);
+
+  console.print("\x1b[7m   STATUS     \x1b[0m"); // reversed title bar
+}
+
+void loop(void)
+{
+  // the labels are the same every time - only the changed digits are sent
+  console.print("\x1b[3;1HUptime ");
+  console.print(millis() / 1000);
+  console.print("\x1b[K\x1b[4;1HA0     ");
+  console.print(analogRead(0));
+  console.print("\x1b[K");
+  console.refresh();
+
+  delay(100);
+}
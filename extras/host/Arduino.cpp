@@ -0,0 +1,33 @@
+/*
+ * Host stand-ins for the Arduino core - see Arduino.h
+ */
+
+#include <time.h>
+
+#include "Arduino.h"
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+void analogWrite(uint8_t, int) {}
+
+static unsigned long long nowMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static unsigned long long sStart = nowMicros();
+
+unsigned long millis()
+{
+  return (unsigned long)((nowMicros() - sStart) / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(nowMicros() - sStart);
+}
+
+void delay(unsigned long) {}
+void delayMicroseconds(unsigned int) {}
@@ -0,0 +1,39 @@
+/*
+ * Just enough of the Arduino core to build the nokiaLCD library on a host
+ * (g++ on Linux). Pin functions do nothing, delays return at once and the
+ * clock is the host's. See README for how to build.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "avr/pgmspace.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+void analogWrite(uint8_t pin, int val);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+inline void interrupts() {}
+inline void noInterrupts() {}
+
+#include "Print.h"
+
+#endif // Arduino_h
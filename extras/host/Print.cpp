@@ -0,0 +1,51 @@
+/*
+ * Host version of the Arduino Print class
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Print.h"
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  while (size--)
+    n += write(*buffer++);
+  return n;
+}
+
+size_t Print::write(const char *str)
+{
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t Print::print(const char *str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base)
+{
+  if (base == DEC) {
+    char buf[24];
+    snprintf(buf, sizeof(buf), "%ld", n);
+    return write(buf);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[24];
+  snprintf(buf, sizeof(buf), (base == HEX) ? "%lX" : "%lu", n);
+  return write(buf);
+}
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
@@ -0,0 +1,39 @@
+/*
+ * Host version of the Arduino Print class - the subset the library and
+ * the examples use
+ */
+
+#ifndef Print_h
+#define Print_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DEC 10
+#define HEX 16
+
+class Print {
+public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str);
+
+  size_t print(const char *str);
+  size_t print(char c);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+
+  size_t println();
+  size_t println(const char *str);
+  size_t println(char c);
+  size_t println(int n, int base = DEC);
+  size_t println(unsigned int n, int base = DEC);
+  size_t println(long n, int base = DEC);
+  size_t println(unsigned long n, int base = DEC);
+};
+
+#endif // Print_h
@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for avr-libc's pgmspace.h - flash is just memory
+ */
+
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+
+typedef char prog_char;
+typedef unsigned char prog_uchar;
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define memcpy_P(dest, src, n) memcpy((dest), (src), (n))
+
+#endif
@@ -0,0 +1,37 @@
+/*
+ * Just enough of the Arduino core to compile nokiaTransport.cpp with
+ * avr-gcc for `make avr-timing` - the code is only disassembled, never
+ * linked, so the core functions are declared and nothing more.
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT  0x0
+#define OUTPUT 0x1
+
+// the uno's spi pins
+#define SS   10
+#define MOSI 11
+#define MISO 12
+#define SCK  13
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+
+volatile uint8_t* portOutputRegister(uint8_t port);
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+
+#endif // Arduino_h
@@ -0,0 +1,8 @@
+/*
+ * Print for `make avr-timing` - nokiaTransport.cpp includes nokiaLCD.h for
+ * its build options, which needs the class. The host one will do; its
+ * avr/pgmspace.h stub must not come before avr-libc's, so it isn't on the
+ * include path.
+ */
+
+#include "../Print.h"
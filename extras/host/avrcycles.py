@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+"""
+Cycle counts of the AVR transports, for the pcd8544Timing presets.
+
+Reads the disassembly of nokiaTransport.cpp built with avr-gcc
+(`avr-objdump -d -r -C`, see `make avr-timing`), follows the branches of
+nokiaBitBang's and nokiaHardwareSPI's transfer, select, deselect and
+setDC, and prints the presets for pcd8544Emulator.cpp.
+
+    ./avrcycles.py out/nokiaTransport.avr.lst [wiring_digital.lst]
+
+Cycles are the ATmega328 figures from the AVR instruction set manual. A
+conditional branch or skip is counted as taken half the time - for the
+bit-bang transfer that is a data bit of 1 half the time.
+
+digitalWrite() is in the Arduino core, not in the library. Give the
+disassembly of the core's wiring_digital.o as well to count it too;
+otherwise DIGITALWRITE_CYCLES is used.
+"""
+
+import re
+import sys
+
+# one digitalWrite() for the 1.0.x core on an Uno, call and return included,
+# when the core's listing isn't given - pin to port and mask through the
+# progmem tables, the pwm timer check, and an SREG save around the write
+DIGITALWRITE_CYCLES = 56
+
+# calling a transport method through the vtable from nokiaLCD:
+# ld/ldd of the vtable pointer (4), ldd of the entry (4), icall (3)
+VIRTUAL_CALL_CYCLES = 11
+
+# the SPI shifts a bit every 4 cpu cycles at fosc/4
+SPI_CYCLES_PER_BIT = 4
+
+# fixed cycle counts - anything not here and not a branch is 1 cycle
+CYCLES = {
+    'ld': 2, 'ldd': 2, 'lds': 2, 'st': 2, 'std': 2, 'sts': 2,
+    'lpm': 3, 'elpm': 3, 'push': 2, 'pop': 2,
+    'adiw': 2, 'sbiw': 2, 'mul': 2, 'muls': 2, 'mulsu': 2,
+    'fmul': 2, 'fmuls': 2, 'fmulsu': 2, 'cbi': 2, 'sbi': 2,
+    'rjmp': 2, 'ijmp': 2, 'jmp': 3,
+    'rcall': 3, 'icall': 3, 'call': 4,
+    'ret': 4, 'reti': 4,
+}
+SKIPS = ('cpse', 'sbrc', 'sbrs', 'sbic', 'sbis')
+WIDE = ('call', 'jmp', 'lds', 'sts') # two word instructions
+
+LINE = re.compile(r'^\s*([0-9a-f]+):\s+(?:[0-9a-f]{2} )+\s*(\w+)\s*([^;]*)')
+LABEL = re.compile(r'^[0-9a-f]+ <(.+)>:$')
+RELOC = re.compile(r'^\s*[0-9a-f]+: R_AVR_\w+\s+(\S+)')
+
+
+def read_listing(path):
+    """ {function name: [(address, mnemonic, operands, call target)]} """
+    functions = {}
+    code = None
+    for text in open(path):
+        text = text.rstrip('\n')
+        m = LABEL.match(text)
+        if m:
+            code = functions.setdefault(m.group(1), [])
+            continue
+        if code is None:
+            continue
+        m = RELOC.match(text)
+        if m and code:
+            addr, op, args, _ = code[-1]
+            code[-1] = (addr, op, args, m.group(1).split('+')[0])
+            continue
+        m = LINE.match(text)
+        if m:
+            code.append((int(m.group(1), 16), m.group(2), m.group(3).strip(), None))
+    return functions
+
+
+def find(functions, name):
+    for key, code in functions.items():
+        if key.startswith(name + '('):
+            return code
+    sys.exit('avrcycles: %s is not in the listing' % name)
+
+
+def cycles(functions, code, start=0, stop=None, external=None):
+    """
+    Average cycles from instruction start to a ret (or to the address stop).
+    Forward branches are averaged, backward ones (a wait loop) are counted
+    once as not taken. Calls are followed into the listing when the callee
+    is in it, otherwise they cost external[callee] on top of the call.
+    """
+    index = dict((addr, i) for i, (addr, _, _, _) in enumerate(code))
+    memo = {}
+
+    def target(i, args):
+        m = re.match(r'\.([+-]\d+)', args.split(',')[-1].strip())
+        if not m:
+            return None
+        return index.get(code[i][0] + 2 + int(m.group(1)))
+
+    def size(i):
+        return 2 if code[i][1] in WIDE else 1
+
+    def path(i):
+        if i is None or i >= len(code):
+            return 0.0
+        if stop is not None and code[i][0] >= stop:
+            return 0.0
+        if i in memo:
+            return memo[i]
+        addr, op, args, callee = code[i]
+        if op in ('ret', 'reti'):
+            total = CYCLES[op]
+        elif op in SKIPS:
+            # not skipped: 1, skipped: 1 + the words skipped
+            skipped = i + 2 if i + 1 < len(code) else None
+            over = size(i + 1) if i + 1 < len(code) else 1
+            total = 0.5 * (1 + path(i + 1)) + 0.5 * (1 + over + path(skipped))
+        elif op.startswith('br'):
+            t = target(i, args)
+            if t is not None and t > i:
+                total = 0.5 * (1 + path(i + 1)) + 0.5 * (2 + path(t))
+            else:
+                total = 1 + path(i + 1) # a loop - once through
+        elif op == 'rjmp':
+            t = target(i, args)
+            total = CYCLES[op] + (path(t) if t is not None and t > i else 0)
+        elif op in ('call', 'rcall'):
+            total = CYCLES[op] + callee_cycles(callee) + path(i + 1)
+        elif op == 'jmp' and callee is not None:
+            total = CYCLES[op] + callee_cycles(callee) # a tail call
+        else:
+            total = CYCLES.get(op, 1) + path(i + 1)
+        memo[i] = total
+        return total
+
+    def callee_cycles(callee):
+        if callee is None:
+            return 0
+        for key, body in functions.items():
+            if key.split('(')[0] == callee and body is not code:
+                return cycles(functions, body, external=external) - CYCLES['call']
+        if external and callee in external:
+            return external[callee] - CYCLES['call']
+        sys.exit('avrcycles: no cycle count for a call to %s' % callee)
+
+    return path(start)
+
+
+def bits_start_stop(code):
+    """ the unrolled bits: from the first bit test of data to the SREG restore """
+    start = next(i for i, c in enumerate(code) if c[1] in ('sbrs', 'sbrc'))
+    stop = next(c[0] for c in code[start:] if c[1] == 'out' and c[2].startswith('0x3f'))
+    return start, stop
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit(__doc__)
+    functions = read_listing(sys.argv[1])
+
+    digital_write = DIGITALWRITE_CYCLES
+    if len(sys.argv) > 2:
+        core = read_listing(sys.argv[2])
+        digital_write = cycles(core, find(core, 'digitalWrite')) + CYCLES['call']
+    external = {'digitalWrite': digital_write}
+
+    def method(cls, name):
+        return cycles(functions, find(functions, cls + '::' + name), external=external) + VIRTUAL_CALL_CYCLES
+
+    # nokiaBitBang on cached port registers
+    transfer = find(functions, 'nokiaBitBang::transfer')
+    start, stop = bits_start_stop(transfer)
+    bits = cycles(functions, transfer, start, stop)
+    port_bit = int(bits / 8)
+    port_byte = int(round(method('nokiaBitBang', 'transfer') - 8 * port_bit))
+    port_select = int(round(method('nokiaBitBang', 'select') + method('nokiaBitBang', 'deselect') +
+                            method('nokiaBitBang', 'setDC')))
+
+    # nokiaHardwareSPI - the wait loop is once through, the rest of the byte is the spi's own time
+    spi_byte = int(round(method('nokiaHardwareSPI', 'transfer')))
+    spi_select = int(round(method('nokiaHardwareSPI', 'select') + method('nokiaHardwareSPI', 'deselect') +
+                           method('nokiaHardwareSPI', 'setDC')))
+
+    # nokiaBitBang through digitalWrite is the portable code, which isn't built for AVR -
+    # three digitalWrite()s a bit, three more for select, D/C and deselect
+    dw_bit = int(round(3 * digital_write))
+    dw_select = int(round(3 * (digital_write + VIRTUAL_CALL_CYCLES)))
+
+    print('// %s: %.1f cycles for the 8 bits, digitalWrite() %.0f cycles'
+          % (sys.argv[1], bits, digital_write))
+    print('const pcd8544Timing PCD8544_TIMING_DIGITALWRITE = { 16000000UL, %d, %d, %d };'
+          % (dw_bit, port_byte, dw_select))
+    print('const pcd8544Timing PCD8544_TIMING_PORT = { 16000000UL, %d, %d, %d };'
+          % (port_bit, port_byte, port_select))
+    print('const pcd8544Timing PCD8544_TIMING_SPI = { 16000000UL, %d, %d, %d };'
+          % (SPI_CYCLES_PER_BIT, spi_byte, spi_select))
+
+
+if __name__ == '__main__':
+    main()
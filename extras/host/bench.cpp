@@ -0,0 +1,143 @@
+/*
+ * Bus cost of each nokiaLCD operation, measured on the emulator.
+ *
+ * Every operation starts from a freshly cleared display and is run in
+ * immediate mode, then again in deferred mode followed by update().
+ * Results go to stdout as CSV, one line per operation and mode, so runs
+ * from different releases can be diffed or plotted:
+ *
+ *   ./bench > bench.csv
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nokiaLCD.h"
+#include "pcd8544Emulator.h"
+
+static byte sBitmap[LCDROWMAX * LCDCOLMAX];
+static const prog_char sBitmapP[16 * 2] PROGMEM = {
+  0x00, 0x1c, 0x22, 0x41, 0x55, 0x41, 0x49, 0x22, 0x1c, 0x00, 0x7e, 0x7e, 0x18, 0x18, 0x7e, 0x7e,
+  0x00, 0x1c, 0x22, 0x41, 0x55, 0x41, 0x49, 0x22, 0x1c, 0x00, 0x7e, 0x7e, 0x18, 0x18, 0x7e, 0x7e,
+};
+// an 84x16 banner - the icon above and blank to the right, packbits encoded
+static const prog_char sBitmapRLE[] PROGMEM = {
+  15, 0x00, 0x1c, 0x22, 0x41, 0x55, 0x41, 0x49, 0x22, 0x1c, 0x00, 0x7e, 0x7e, 0x18, 0x18, 0x7e, 0x7e,
+  '\xbd', 0x00, // 68 x 0x00
+  15, 0x00, 0x1c, 0x22, 0x41, 0x55, 0x41, 0x49, 0x22, 0x1c, 0x00, 0x7e, 0x7e, 0x18, 0x18, 0x7e, 0x7e,
+  '\xbd', 0x00,
+};
+
+static pcd8544Emulator sLcd;
+static nokiaDisplay sDisplay(sLcd, 10);
+
+typedef void (*benchFunc)();
+
+static void benchClear() { sDisplay.clear(); }
+static void benchUpdate() { sDisplay.invalidate(); }
+static void benchWriteChar() { sDisplay.writeChar('A'); }
+static void benchPrintScreen()
+{
+  // 6 lines of 14 chars - fills the screen
+  for (byte i = 0; i < LCDROWMAX; i++)
+    sDisplay.print("0123456789ABCD");
+}
+static void benchPrintScaled()
+{
+  sDisplay.setTextScale(2);
+  sDisplay.print("12:34");
+  sDisplay.setTextScale(1);
+}
+static void benchTerminalLine()
+{
+  // a screen of log lines, then one more - the screen scrolls up a line
+  sDisplay.setTerminalMode(true);
+  for (byte i = 0; i < LCDROWMAX - 1; i++)
+    sDisplay.println(i * 1111);
+  sDisplay.update();
+  sLcd.resetCounters(); // only the last line is measured
+  sDisplay.setCursor(LCDROWMAX - 1, 0);
+  sDisplay.println("t=12345 ok");
+  sDisplay.setTerminalMode(false);
+}
+static void benchDrawText() { sDisplay.drawText(3, 13, "Hello World!"); }
+static void benchStringBig() { sDisplay.writeStringBig(0, 0, (char*)"12.5"); }
+static void benchLineHorizontal() { sDisplay.drawLine(0, 20, 83, 20, PIXEL_ON); }
+static void benchLineVertical() { sDisplay.drawLine(40, 0, 40, 47, PIXEL_ON); }
+static void benchLineDiagonal() { sDisplay.drawLine(0, 0, 47, 47, PIXEL_ON); }
+static void benchLineShallow() { sDisplay.drawLine(0, 0, 83, 47, PIXEL_ON); }
+static void benchLineSteep() { sDisplay.drawLine(30, 0, 50, 47, PIXEL_ON); }
+static void benchRectangle() { sDisplay.drawRectangle(10, 10, 73, 37, PIXEL_ON); }
+static void benchCircle() { sDisplay.drawCircle(48, 24, 20, PIXEL_ON); }
+static void benchFilledRectangle() { sDisplay.drawFilledRectangle(10, 10, 73, 37, PIXEL_ON); }
+static void benchFilledScreen() { sDisplay.drawFilledRectangle(0, 0, 83, 47, PIXEL_XOR); }
+static void benchBitmap() { sDisplay.drawBitmap(0, 0, sBitmap, LCDCOLMAX, LCDPIXELROWMAX); }
+static void benchBitmapP() { sDisplay.drawBitmapP(20, 2, sBitmapP, 16, 16); }
+static void benchBlitP() { sDisplay.blitP(20, 13, sBitmapP, 16, 16, BLIT_XOR); }
+static void benchBitmapRLE() { sDisplay.drawBitmapRLE_P(0, 2, sBitmapRLE, LCDCOLMAX, 16); }
+
+struct benchCase {
+  const char* name;
+  benchFunc func;
+};
+
+static const benchCase sCases[] = {
+  { "clear", benchClear },
+  { "update_full", benchUpdate },
+  { "writeChar", benchWriteChar },
+  { "print_screen", benchPrintScreen },
+  { "print_x2", benchPrintScaled },
+  { "drawText_y13", benchDrawText },
+  { "println_terminal", benchTerminalLine },
+  { "writeStringBig", benchStringBig },
+  { "drawLine_horizontal", benchLineHorizontal },
+  { "drawLine_vertical", benchLineVertical },
+  { "drawLine_45", benchLineDiagonal },
+  { "drawLine_shallow", benchLineShallow },
+  { "drawLine_steep", benchLineSteep },
+  { "drawRectangle", benchRectangle },
+  { "drawCircle_48_24_20", benchCircle },
+  { "drawFilledRectangle", benchFilledRectangle },
+  { "drawFilledRectangle_screen", benchFilledScreen },
+  { "drawBitmap_screen", benchBitmap },
+  { "drawBitmapP_16x16", benchBitmapP },
+  { "drawBitmapRLE_P_84x16", benchBitmapRLE },
+  { "blitP_16x16_y13", benchBlitP },
+};
+
+static void run(const benchCase& c, byte mode)
+{
+  sDisplay.setDrawMode(DRAW_IMMEDIATE);
+  sDisplay.clear();
+  sDisplay.setDrawMode(mode);
+  sLcd.resetCounters();
+
+  c.func();
+  if (mode == DRAW_DEFERRED)
+    sDisplay.update();
+  else if (c.func == benchUpdate)
+    sDisplay.update(); // update() is the operation itself
+
+  printf("%s,%s,%lu,%lu,%lu,%.1f,%.1f,%.1f,%lu\n",
+         c.name, (mode == DRAW_DEFERRED) ? "deferred" : "immediate",
+         sLcd.commandBytes, sLcd.dataBytes, sLcd.selects,
+         sLcd.estimatedMicros(PCD8544_TIMING_DIGITALWRITE),
+         sLcd.estimatedMicros(PCD8544_TIMING_PORT),
+         sLcd.estimatedMicros(PCD8544_TIMING_SPI),
+         sLcd.badCommands + sLcd.unselectedBytes);
+}
+
+int main()
+{
+  for (unsigned int i = 0; i < sizeof(sBitmap); i++)
+    sBitmap[i] = (i & 1) ? 0xaa : 0x55;
+
+  sDisplay.init();
+
+  printf("operation,mode,cmd_bytes,data_bytes,selects,us_digitalwrite_16mhz,us_port_16mhz,us_spi_16mhz,protocol_errors\n");
+  for (unsigned int i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++) {
+    run(sCases[i], DRAW_IMMEDIATE);
+    run(sCases[i], DRAW_DEFERRED);
+  }
+  return 0;
+}
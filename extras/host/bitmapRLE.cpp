@@ -0,0 +1,161 @@
+/*
+ * Converts a pbm image into a PackBits encoded progmem array for
+ * drawBitmapRLE_P(). Black pixels are on.
+ *
+ *   ./bitmapRLE image.pbm name > image.h
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+typedef std::vector<unsigned char> bytes;
+
+// next header number of a pbm, skipping white space and comments
+static int pbmNumber(FILE* f)
+{
+  int c = fgetc(f);
+  while (c != EOF && (isspace(c) || c == '#')) {
+    if (c == '#')
+      while (c != EOF && c != '\n') c = fgetc(f);
+    c = fgetc(f);
+  }
+  int n = -1;
+  while (c != EOF && isdigit(c)) {
+    n = (n < 0 ? 0 : n * 10) + c - '0';
+    c = fgetc(f);
+  }
+  return n;
+}
+
+// the image as rows of 0/1 pixels - P1 (text) or P4 (binary)
+static bool readPBM(const char* path, int& w, int& h, bytes& pixels)
+{
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return false;
+
+  char magic[2];
+  bool ok = fread(magic, 1, 2, f) == 2 && magic[0] == 'P' && (magic[1] == '1' || magic[1] == '4');
+  w = ok ? pbmNumber(f) : -1;
+  h = ok ? pbmNumber(f) : -1;
+  ok = w > 0 && h > 0 && w <= 255 && h <= 255;
+
+  pixels.assign(ok ? w * h : 0, 0);
+  for (int y = 0; ok && y < h; y++) {
+    if (magic[1] == '4') {
+      for (int x = 0; ok && x < w; x += 8) {
+        int c = fgetc(f);
+        ok = c != EOF;
+        for (int b = 0; b < 8 && x + b < w; b++)
+          pixels[y * w + x + b] = (c >> (7 - b)) & 1;
+      }
+    } else {
+      for (int x = 0; ok && x < w; x++) {
+        int c;
+        do c = fgetc(f); while (c != EOF && c != '0' && c != '1');
+        ok = c != EOF;
+        pixels[y * w + x] = c == '1';
+      }
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+// the drawBitmapP() layout - a bank at a time, one byte per column, bit 0 at the top
+static bytes toBanks(int w, int h, const bytes& pixels)
+{
+  bytes out;
+  for (int bank = 0; bank < (h + 7) / 8; bank++) {
+    for (int x = 0; x < w; x++) {
+      unsigned char v = 0;
+      for (int b = 0; b < 8 && bank * 8 + b < h; b++)
+        if (pixels[(bank * 8 + b) * w + x])
+          v |= 1 << b;
+      out.push_back(v);
+    }
+  }
+  return out;
+}
+
+// runs of 3 or more equal bytes are repeated, everything else is copied
+static bytes packBits(const bytes& in)
+{
+  bytes out;
+  size_t i = 0;
+  while (i < in.size()) {
+    size_t run = 1;
+    while (i + run < in.size() && run < 128 && in[i + run] == in[i])
+      run++;
+    if (run >= 3) {
+      out.push_back(257 - run);
+      out.push_back(in[i]);
+      i += run;
+      continue;
+    }
+
+    size_t start = i;
+    while (i < in.size() && i - start < 128) {
+      if (i + 2 < in.size() && in[i] == in[i + 1] && in[i] == in[i + 2])
+        break;
+      i++;
+    }
+    out.push_back(i - start - 1);
+    out.insert(out.end(), in.begin() + start, in.begin() + i);
+  }
+  return out;
+}
+
+// the same decoding as drawBitmapRLE_P() - to check the encoder
+static bytes unpackBits(const bytes& in, size_t size)
+{
+  bytes out;
+  size_t i = 0;
+  while (out.size() < size && i < in.size()) {
+    unsigned char ctl = in[i++];
+    if (ctl == 128)
+      continue;
+    if (ctl > 128) {
+      out.insert(out.end(), 257 - ctl, in[i++]);
+    } else {
+      out.insert(out.end(), in.begin() + i, in.begin() + i + ctl + 1);
+      i += ctl + 1;
+    }
+  }
+  return out;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s image.pbm name\n", argv[0]);
+    return 2;
+  }
+
+  int w, h;
+  bytes pixels;
+  if (!readPBM(argv[1], w, h, pixels)) {
+    fprintf(stderr, "%s: can't read %s - needs a P1 or P4 pbm of at most 255x255\n", argv[0], argv[1]);
+    return 1;
+  }
+
+  bytes raw = toBanks(w, h, pixels);
+  bytes packed = packBits(raw);
+  if (unpackBits(packed, raw.size()) != raw) {
+    fprintf(stderr, "%s: encoding check failed\n", argv[0]);
+    return 1;
+  }
+
+  printf("// %s - %dx%d, %u bytes packed from %u\n", argv[1], w, h,
+         (unsigned)packed.size(), (unsigned)raw.size());
+  printf("// display.drawBitmapRLE_P(x, y, %s, %d, %d);\n", argv[2], w, h);
+  printf("static const prog_char %s[] PROGMEM = {", argv[2]);
+  for (size_t i = 0; i < packed.size(); i++)
+    printf("%s'\\x%02x'%s", i % 10 ? " " : "\n  ", packed[i], i + 1 < packed.size() ? "," : ""); // no narrowing from a signed prog_char
+  printf("\n};\n");
+  return 0;
+}
@@ -0,0 +1,1125 @@
+/*
+ * Randomized checks of the nokiaLCD library against reference models.
+ *
+ * The display is driven through ramModel, a mock transport that decodes
+ * the command/data stream into the controller's ram on its own - for
+ * whichever LCD_CONTROLLER is built - and every drawing operation is
+ * repeated on a plain array of pixels. After each batch the two must
+ * agree. `make check` builds this once per build option and runs it:
+ *
+ *   ./check        prints one line per check, exits 1 on a failure
+ *
+ * With USE_ASYNC_UPDATE every check runs twice: with the mock's interrupt
+ * (raiseInterrupt() sends the next byte) and without, with a simulated
+ * timer isr calling flushStep() in the middle of every bus call.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nokiaLCD.h"
+#include "nokiaConsole.h"
+#include "nokiaScheduler.h"
+#include "font_5x7.h"
+#include "font_prop.h"
+#include "font_prop_big.h"
+
+#ifndef USE_PAGED_BUFFER
+extern unsigned char big_number_font[]; // font_big.h, in nokiaLCD.cpp
+#endif
+
+// the controller's ram, a little more than the visible screen
+#if LCD_CONTROLLER == LCD_ST7565
+#define RAM_COLS  132
+#define RAM_BANKS 8
+#elif LCD_CONTROLLER == LCD_PCF8812
+#define RAM_COLS  102
+#define RAM_BANKS 9
+#else
+#define RAM_COLS  84
+#define RAM_BANKS 6
+#endif
+
+
+// ******************** the controller ************************************************
+
+class ramModel : public nokiaMockTransport {
+public:
+  ramModel() : mTimer(0) { reset(); }
+
+  void reset()
+  {
+    nokiaMockTransport::reset();
+    memset(mRam, 0, sizeof(mRam));
+    mX = 0;
+    mY = 0;
+    mState = 0x20;
+    mArgument = false;
+    mSelected = false;
+    mDC = HIGH;
+    unselectedBytes = 0;
+    overlappedBytes = 0;
+    extraDeselects = 0;
+  }
+
+  bool pixel(int x, int y) { return (mRam[y / 8][x] >> (y % 8)) & 1; }
+  byte ram(int x, int bank) { return mRam[bank][x]; }
+
+  // call lcd.flushStep() from every bus call, as a timer isr could
+  void setTimer(nokiaDisplay* lcd) { mTimer = lcd; }
+  void timerInterrupt()
+  {
+#ifdef USE_ASYNC_UPDATE
+    static bool inIsr = false; // an isr doesn't interrupt itself
+    if (mTimer && !inIsr) {
+      inIsr = true;
+      mTimer->flushStep();
+      inIsr = false;
+    }
+#endif
+  }
+
+  virtual void select() { mSelected = true; nokiaMockTransport::select(); timerInterrupt(); }
+  virtual void deselect()
+  {
+    if (!mSelected)
+      extraDeselects++; // something was ended twice
+    mSelected = false;
+    nokiaMockTransport::deselect();
+    timerInterrupt();
+  }
+  // the library asks this between its test of the update and its step
+  virtual bool canInterrupt()
+  {
+    bool on = nokiaMockTransport::canInterrupt();
+    if (!on)
+      timerInterrupt();
+    return on;
+  }
+  virtual void setDC(byte dc) { mDC = dc; nokiaMockTransport::setDC(dc); timerInterrupt(); }
+  virtual void transfer(byte data)
+  {
+    if (!mSelected)
+      unselectedBytes++;
+    if (pending())
+      overlappedBytes++; // started before the last one was done
+    nokiaMockTransport::transfer(data);
+    if (mDC == LOW)
+      command(data);
+    else
+      write(data);
+    timerInterrupt();
+  }
+
+  unsigned long unselectedBytes;
+  unsigned long overlappedBytes;
+  unsigned long extraDeselects;
+
+private:
+#if LCD_CONTROLLER == LCD_ST7565
+  void command(byte cmd)
+  {
+    if (mArgument) // the value of a two byte command
+      mArgument = false;
+    else if (cmd == 0x81 || cmd == 0xf8 || cmd == 0xac || cmd == 0xad)
+      mArgument = true;
+    else if ((cmd & 0xf0) == 0xb0) {
+      if ((cmd & 0x0f) < RAM_BANKS)
+        mY = cmd & 0x0f;
+    }
+    else if ((cmd & 0xf0) == 0x10)
+      mX = ((cmd & 0x0f) << 4) | (mX & 0x0f);
+    else if ((cmd & 0xf0) == 0x00)
+      mX = (mX & 0xf0) | cmd;
+    else if (cmd == 0xe2) {
+      mX = 0;
+      mY = 0;
+    }
+  }
+
+  void write(byte data)
+  {
+    if (mX < RAM_COLS) // the column stops at the end of the page
+      mRam[mY][mX++] = data;
+  }
+#else
+  void command(byte cmd)
+  {
+    if ((cmd & 0xf8) == 0x20)
+      mState = cmd;
+    else if (!(mState & 0x01)) { // basic instruction set
+      if ((cmd & 0x80) && (cmd & 0x7f) < RAM_COLS)
+        mX = cmd & 0x7f;
+      else if ((cmd & 0xf8) == 0x40 && (cmd & 0x07) < RAM_BANKS)
+        mY = cmd & 0x07;
+    }
+  }
+
+  void write(byte data)
+  {
+    mRam[mY][mX] = data;
+    if (mState & 0x02) { // vertical addressing
+      if (++mY >= RAM_BANKS) {
+        mY = 0;
+        if (++mX >= RAM_COLS)
+          mX = 0;
+      }
+    }
+    else if (++mX >= RAM_COLS) {
+      mX = 0;
+      if (++mY >= RAM_BANKS)
+        mY = 0;
+    }
+  }
+#endif
+
+  nokiaDisplay* mTimer;
+  byte mRam[RAM_BANKS][RAM_COLS];
+  byte mX;
+  byte mY;
+  byte mState; // PCD8544 function set
+  bool mArgument; // ST7565 - the next command byte is a value
+  bool mSelected;
+  byte mDC;
+};
+
+
+static ramModel sModel;
+static nokiaDisplay sDisplay(sModel, 10);
+static nokiaDisplay& display = sDisplay; // for testing/animationTest.h
+
+// what should be on the screen
+static bool sRef[LCD_X][LCD_Y];
+#ifndef USE_PAGED_BUFFER
+static bool sSnap[LCD_X][LCD_Y]; // what was on it
+#endif
+
+static unsigned long sSeed = 1;
+
+static unsigned int rnd(unsigned int n)
+{
+  sSeed = sSeed * 1103515245UL + 12345UL;
+  return (unsigned int)((sSeed >> 16) & 0x7fff) % n;
+}
+
+static int rndRange(int from, int to)
+{
+  return from + (int)rnd(to - from + 1);
+}
+
+
+// ******************** helpers ************************************************
+
+// a fresh display, in the given draw mode
+static void start(byte mode)
+{
+  sModel.reset();
+  sDisplay.init();
+#ifdef USE_GRAPHIC
+  sDisplay.setDrawMode(mode);
+#endif
+  memset(sRef, 0, sizeof(sRef));
+}
+
+// pixels that differ from what is expected
+static unsigned int compare(bool (*expected)[LCD_Y])
+{
+  unsigned int bad = 0;
+  for (int x = 0; x < LCD_X; x++)
+    for (int y = 0; y < LCD_Y; y++)
+      if (sModel.pixel(x, y) != expected[x][y])
+        bad++;
+  return bad;
+}
+
+static unsigned int protocolErrors()
+{
+  return sModel.unselectedBytes + sModel.overlappedBytes + sModel.extraDeselects;
+}
+
+static void refPixel(int x, int y, byte c)
+{
+  if (x < 0 || x >= LCD_X || y < 0 || y >= LCD_Y)
+    return;
+  if (c == PIXEL_XOR)
+    sRef[x][y] = !sRef[x][y];
+  else
+    sRef[x][y] = (c == PIXEL_ON);
+}
+
+static void refRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
+{
+  for (int x = (x1 < x2 ? x1 : x2); x <= (x1 < x2 ? x2 : x1); x++)
+    for (int y = (y1 < y2 ? y1 : y2); y <= (y1 < y2 ? y2 : y1); y++)
+      refPixel(x, y, c);
+}
+
+// drawLine() against the Bresenham line the library started with
+static void refLine(byte x1, byte y1, byte x2, byte y2, byte c)
+{
+  int dx = x2 - x1, dy = y2 - y1, stepx = 1, stepy = 1, fraction;
+
+  if (dy < 0) { dy = -dy; stepy = -1; }
+  if (dx < 0) { dx = -dx; stepx = -1; }
+  dx <<= 1;
+  dy <<= 1;
+  refPixel(x1, y1, c);
+  if (dx > dy) {
+    fraction = dy - (dx >> 1);
+    while (x1 != x2) {
+      if (fraction >= 0) { y1 += stepy; fraction -= dx; }
+      x1 += stepx;
+      fraction += dy;
+      refPixel(x1, y1, c);
+    }
+  }
+  else {
+    fraction = dx - (dy >> 1);
+    while (y1 != y2) {
+      if (fraction >= 0) { x1 += stepx; fraction -= dy; }
+      y1 += stepy;
+      fraction += dx;
+      refPixel(x1, y1, c);
+    }
+  }
+}
+
+static void refBlit(int x, int y, const byte* map, byte w, byte h, byte op, const byte* mask)
+{
+  for (int j = 0; j < h; j++)
+    for (int i = 0; i < w; i++) {
+      int px = x + i, py = y + j;
+      if (px < 0 || px >= LCD_X || py < 0 || py >= LCD_Y)
+        continue;
+      int index = (j / 8) * w + i;
+      if (mask && !((mask[index] >> (j % 8)) & 1))
+        continue;
+      bool s = (map[index] >> (j % 8)) & 1;
+      bool& d = sRef[px][py];
+      if (op == BLIT_COPY)
+        d = s;
+      else if (op == BLIT_OR)
+        d = d || s;
+      else if (op == BLIT_AND)
+        d = d && s;
+      else
+        d = d != s;
+    }
+}
+
+// the glyph of smallFont at a scale, with its blank column, reversed or not -
+// a space for the chars it doesn't have
+static bool refGlyphPixel(byte ch, byte scale, bool reversed, int gx, int gy)
+{
+  int col = gx / scale, row = gy / scale;
+  if (ch > 123)
+    ch = ' ';
+  byte bits = (col < 5) ? smallFont[(ch - 32) * 5 + col] : 0;
+  bool on = (bits >> row) & 1;
+  return reversed ? !on : on;
+}
+
+#ifndef USE_PAGED_BUFFER
+// everything drawn so far onto the display - update() and, for a background
+// update, the interrupts or timer ticks that send it
+static void settle()
+{
+  sDisplay.update();
+#ifdef USE_ASYNC_UPDATE
+  while (sDisplay.isFlushing()) {
+    if (sModel.canInterrupt())
+      sModel.raiseInterrupt();
+    else
+      sModel.timerInterrupt();
+  }
+#endif
+}
+
+static void snapshot()
+{
+  for (int x = 0; x < LCD_X; x++)
+    for (int y = 0; y < LCD_Y; y++)
+      sSnap[x][y] = sModel.pixel(x, y);
+}
+
+// a few random pixels set, cleared or flipped on the display and the reference
+static void randomPixels()
+{
+  for (int n = rnd(30); n >= 0; n--) {
+    byte x = rnd(LCD_X), y = rnd(LCD_Y), c = rnd(3);
+    sDisplay.setPixel(x, y, c);
+    refPixel(x, y, c);
+  }
+}
+
+// a random bitmap blitted onto the display and the reference, some of it off screen
+static void randomBlit(byte op)
+{
+  static byte map[4 * 255], mask[4 * 255];
+  byte w = rndRange(1, 30), h = rndRange(1, 30);
+  int x = rndRange(-30, LCD_X + 10), y = rndRange(-30, LCD_Y + 10);
+  bool masked = rnd(2);
+
+  for (int i = 0; i < w * ((h + 7) / 8); i++) {
+    map[i] = rnd(256);
+    mask[i] = rnd(256);
+  }
+  sDisplay.blit(x, y, map, w, h, op, masked ? mask : 0);
+  refBlit(x, y, map, w, h, op, masked ? mask : 0);
+}
+
+// text or a bitmap, drawn in whole banks onto the display and the reference
+static void randomBankDrawing()
+{
+  static prog_char map[LCDROWMAX * LCD_X];
+  byte x = rnd(LCD_X - 12), bank = rnd(LCDROWMAX - 2);
+  byte w = rndRange(1, LCD_X - x), h = rndRange(1, (LCDROWMAX - bank) * 8);
+  byte ch, gx, gy;
+
+  for (unsigned int i = 0; i < sizeof(map); i++)
+    map[i] = rnd(256);
+
+  switch (rnd(4)) {
+  case 0:
+    ch = rndRange(32, 123);
+    sDisplay.gotoXY(x, bank);
+    sDisplay.writeChar(ch);
+    for (gx = 0; gx < 6; gx++)
+      for (gy = 0; gy < 8; gy++)
+        sRef[x + gx][bank * 8 + gy] = refGlyphPixel(ch, 1, false, gx, gy);
+    break;
+  case 1:
+    ch = rnd(10);
+    sDisplay.writeCharBig(x, bank, '0' + ch);
+    for (gx = 0; gx < 12; gx++)
+      for (gy = 0; gy < 24; gy++)
+        sRef[x + gx][bank * 8 + gy] = (big_number_font[ch * 48 + gy / 8 * 16 + gx] >> (gy % 8)) & 1;
+    break;
+  default:
+    if (rnd(2))
+      sDisplay.drawBitmap(x, bank, (byte*)map, w, h);
+    else
+      sDisplay.drawBitmapP(x, bank, map, w, h);
+    for (gx = 0; gx < w; gx++)
+      for (gy = 0; gy < (h + 7) / 8 * 8; gy++) // whole banks
+        sRef[x + gx][bank * 8 + gy] = ((byte)map[gy / 8 * w + gx] >> (gy % 8)) & 1;
+  }
+}
+#endif
+
+
+// ******************** the checks ************************************************
+
+#ifndef USE_PAGED_BUFFER
+// commands of the user's own between writes - those that aren't addresses
+// must not move where the library thinks the controller's address is
+static unsigned int checkCommands(byte)
+{
+#if LCD_CONTROLLER == LCD_ST7565
+  static const byte commands[][3] = {
+    { 0x81, 0x0a }, // contrast 10 - not column low 10
+    { 0x81, 0x1f }, // nor column high 1
+    { 0xf8, 0x01 }, // booster ratio
+    { 0xad, 0x03 }, // static indicator
+    { 0xa6 }, { 0xa4 }, // not reversed, not all on
+  };
+#else
+  static const byte commands[][3] = {
+    { 0x21, 0x8a, 0x20 }, // Vop in the extended set - not column 10
+    { 0x21, 0x13, 0x20 }, // bias
+    { 0x0c }, // display normal
+  };
+#endif
+  unsigned int bad = 0;
+
+  start(DRAW_IMMEDIATE);
+  for (unsigned int i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+    byte x = rnd(LCD_X - 1), y = rnd(LCDROWMAX);
+    sDisplay.gotoXY(x, y);
+    sDisplay.writeData(0xff);
+    for (byte j = 0; j < 3 && commands[i][j]; j++)
+      sDisplay.writeCommand(commands[i][j]);
+    sDisplay.gotoXY(x, y);
+    sDisplay.writeData(0x5a);
+    if (sModel.ram(x, y) != 0x5a || sModel.ram(x + 1, y) != 0)
+      bad++;
+    sDisplay.clear();
+  }
+  return bad + protocolErrors();
+}
+
+static unsigned int checkPixels(byte mode)
+{
+  unsigned int bad = 0;
+
+  start(mode);
+  for (int t = 0; t < 500; t++) {
+    randomPixels();
+    if (t % 23 == 0) {
+      settle();
+      bad += compare(sRef);
+    }
+  }
+  settle();
+  return bad + compare(sRef) + protocolErrors();
+}
+
+static unsigned int checkBlit(byte mode)
+{
+  unsigned int bad = 0;
+
+  start(mode);
+  for (int t = 0; t < 3000; t++) {
+    if (rnd(5))
+      randomBlit(rnd(4));
+    else
+      randomBankDrawing();
+    if (t % 97 == 0) {
+      settle();
+      bad += compare(sRef);
+    }
+  }
+  settle();
+  return bad + compare(sRef) + protocolErrors();
+}
+
+// every char of the fixed font at every scale, reversed and not, followed by an A -
+// and at scale 1 the chars past the end of the font
+static unsigned int checkText(byte mode)
+{
+  unsigned int bad = 0;
+
+  start(mode);
+  for (byte scale = 1; scale <= 4; scale++)
+    for (int ch = 32; ch <= (scale == 1 ? 255 : 123); ch++) {
+      bool reversed = ch & 1;
+      sDisplay.clear();
+      sDisplay.setTextScale(scale);
+      sDisplay.setTextMode(reversed);
+      sDisplay.gotoXY(3, 1);
+      sDisplay.writeChar(ch);
+      sDisplay.writeChar('A');
+      settle();
+
+      for (int x = 0; x < LCD_X; x++)
+        for (int y = 0; y < LCD_Y; y++) {
+          int gx = x - 3, gy = y - 8, cell = 6 * scale;
+          bool expected = false;
+          if (gy >= 0 && gy < 8 * scale && gx >= 0 && gx < cell)
+            expected = refGlyphPixel(ch, scale, reversed, gx, gy);
+          else if (gy >= 0 && gy < 8 * scale && gx >= cell && gx < 2 * cell)
+            expected = refGlyphPixel('A', scale, reversed, gx - cell, gy);
+          if (sModel.pixel(x, y) != expected)
+            bad++;
+        }
+    }
+  sDisplay.setTextScale(1);
+  sDisplay.setTextMode(false);
+
+  // print() sends a string in bursts - it must come out as writeChar() at a time
+  const char* text = "Hello\nworld, a long line that wraps around the screen\r..and more to wrap past the bottom 0123456789";
+  for (byte pass = 0; pass < 2; pass++) {
+    sDisplay.clear();
+    sDisplay.setTextMode(pass);
+    sDisplay.gotoXY(7, 2);
+    for (const char* p = text; *p; p++)
+      sDisplay.writeChar(*p);
+    settle();
+    snapshot();
+    sDisplay.clear();
+    sDisplay.gotoXY(7, 2);
+    sDisplay.print(text);
+    settle();
+    bad += compare(sSnap);
+  }
+  sDisplay.setTextMode(false);
+  return bad + protocolErrors();
+}
+
+// propFont is smallFont with the blank columns trimmed
+static unsigned int checkPropFont(byte mode)
+{
+  unsigned int bad = 0;
+
+  start(mode);
+  sDisplay.setPropFont(propFont);
+  for (byte ch = 32; ch <= 123; ch++) {
+    const unsigned char* g = smallFont + (ch - 32) * 5;
+    int first = 0, last = 4;
+    while (first < 5 && !g[first])
+      first++;
+    while (last >= 0 && !g[last])
+      last--;
+    int width = (first > last) ? 2 : last - first + 1; // a blank glyph is 2 wide
+
+    sDisplay.clear();
+    sDisplay.home();
+    sDisplay.writeChar(ch);
+    settle();
+    for (int x = 0; x < width; x++)
+      if (sModel.ram(x, 0) != ((first > last) ? 0 : g[first + x]))
+        bad++;
+    if (sModel.ram(width, 0) != 0)
+      bad++;
+  }
+
+  // bigNumFont has a glyph for a few chars only - the rest are spaces, 6 wide
+  sDisplay.setPropFont(bigNumFont);
+  for (int ch = 32; ch < 256; ch++) {
+    if (ch == ' ' || ch == '+' || ch == '-' || ch == '.' || (ch >= '0' && ch <= '9'))
+      continue;
+    sDisplay.clear();
+    sDisplay.home();
+    sDisplay.writeChar(ch);
+    sDisplay.writeChar('.');
+    settle();
+    for (int x = 0; x < 10; x++)
+      if (sModel.ram(x, 2) != ((x >= 7) ? 0x3C : 0))
+        bad++;
+  }
+
+  // at scale 4 bigNumFont would be 12 banks tall - it is drawn at 2, the most that fits
+  sDisplay.clear();
+  sDisplay.home();
+  sDisplay.writeChar('8');
+  settle();
+  snapshot();
+  sDisplay.setFont(smallFont, 5);
+  sDisplay.setTextScale(4);
+  sDisplay.setPropFont(bigNumFont);
+  if (sDisplay.getTextStyle().scale != 2)
+    bad++;
+  sDisplay.clear();
+  sDisplay.home();
+  sDisplay.writeChar('8');
+  settle();
+  for (int x = 0; x < LCD_X; x++)
+    for (int y = 0; y < LCD_Y; y++)
+      if (sModel.pixel(x, y) != sSnap[x / 2][y / 2])
+        bad++;
+  sDisplay.setTextScale(1);
+  sDisplay.setFont(smallFont, 5); // back to the fixed font
+  return bad + protocolErrors();
+}
+
+static unsigned int checkShapes(byte mode)
+{
+  unsigned int bad = 0;
+
+  start(mode);
+  for (int t = 0; t < 2000; t++) {
+    int range = (t % 3 == 0) ? 255 : LCD_X + 16; // some far off the screen
+    byte x1 = rnd(range), y1 = rnd(range * LCD_Y / LCD_X), x2 = rnd(range), y2 = rnd(range * LCD_Y / LCD_X);
+    byte c = rnd(3);
+
+    if (rnd(4)) {
+      sDisplay.drawLine(x1, y1, x2, y2, c);
+      refLine(x1, y1, x2, y2, c);
+    }
+    else {
+      sDisplay.drawFilledRectangle(x1, y1, x2, y2, c);
+      refRectangle(x1, y1, x2, y2, c);
+    }
+    if (t % 89 == 0) {
+      settle();
+      bad += compare(sRef);
+    }
+  }
+  settle();
+  return bad + compare(sRef) + protocolErrors();
+}
+static unsigned int checkScroll(byte mode)
+{
+  static bool moved[LCD_X][LCD_Y];
+  unsigned int bad = 0;
+
+  start(mode);
+  for (int t = 0; t < 1500; t++) {
+    if (rnd(3) == 0)
+      randomBlit(BLIT_XOR);
+    int dx = rnd(3) ? 0 : rndRange(-10, 10);
+    int dy = rnd(2) ? 0 : rndRange(-20, 20);
+    if (rnd(50) == 0)
+      dy = rnd(2) ? LCD_Y + 12 : -LCD_Y - 12;
+
+    sDisplay.scroll(dx, dy);
+    for (int x = 0; x < LCD_X; x++)
+      for (int y = 0; y < LCD_Y; y++) {
+        int fx = x - dx, fy = y - dy;
+        moved[x][y] = (fx >= 0 && fx < LCD_X && fy >= 0 && fy < LCD_Y) ? sRef[fx][fy] : false;
+      }
+    memcpy(sRef, moved, sizeof(sRef));
+
+    if (t % 37 == 0) {
+      settle();
+      bad += compare(sRef);
+    }
+  }
+  settle();
+  bad += compare(sRef);
+
+  // terminal mode - the last lines printed, as if printed on a clear screen
+  sDisplay.clear();
+  sDisplay.setTerminalMode(true);
+  for (int i = 0; i < 20; i++) {
+    sDisplay.print("line ");
+    sDisplay.println(i);
+  }
+  sDisplay.setTerminalMode(false);
+  settle();
+  snapshot();
+  sDisplay.clear();
+  for (int i = 0; i < LCDROWMAX - 1; i++) {
+    sDisplay.setCursor(i, 0);
+    sDisplay.print("line ");
+    sDisplay.print(20 - (LCDROWMAX - 1) + i);
+  }
+  settle();
+  return bad + compare(sSnap) + protocolErrors();
+}
+
+static unsigned int checkScheduler(byte)
+{
+  nokiaScheduler frames(sDisplay, 0, 1); // no frame rate, one byte a tick
+  unsigned int bad = 0;
+  int finished = 0;
+
+  start(DRAW_DEFERRED);
+  for (int t = 0; t < 300; t++) {
+    randomBlit(BLIT_XOR);
+    frames.markDirty();
+    frames.markDirty();
+    for (int k = rnd(50); k > 0; k--) {
+      frames.tick();
+      sModel.raiseInterrupt(); // the byte is out by the next tick
+    }
+  }
+  for (int k = 0; k < 100000; k++) {
+    sModel.raiseInterrupt();
+    if (!frames.tick() && !frames.isFlushing())
+      break;
+  }
+  bad += compare(sRef);
+
+  // any number of frames asked for while one is going out make just one more
+  sDisplay.invalidate();
+  frames.markDirty();
+  for (int k = 0; k < 5000; k++) {
+    if (finished == 0 && frames.isFlushing()) {
+      frames.markDirty();
+      sDisplay.drawLine(0, k % LCD_Y, LCD_X - 1, LCD_Y - 1 - k % LCD_Y, PIXEL_XOR);
+    }
+    sModel.raiseInterrupt();
+    if (frames.tick())
+      finished++;
+  }
+  if (finished != 2)
+    bad++;
+  return bad + protocolErrors();
+}
+
+// the caller's text settings are back after a console refresh
+static bool sameStyle(const nokiaTextStyle& a, const nokiaTextStyle& b)
+{
+  return a.font == b.font && a.fontWidth == b.fontWidth && a.fontLast == b.fontLast &&
+         a.propFont == b.propFont && a.scale == b.scale && a.normalMode == b.normalMode &&
+         a.wrap == b.wrap;
+}
+
+// nokiaConsole's cells against printing the same chars in the same places
+static unsigned int checkConsole(byte mode)
+{
+  static char chars[CONSOLE_ROWS][CONSOLE_COLS];
+  static bool reversed[CONSOLE_ROWS][CONSOLE_COLS];
+  nokiaConsole console(sDisplay);
+  unsigned int bad = 0;
+
+  start(mode);
+  memset(chars, ' ', sizeof(chars));
+  memset(reversed, 0, sizeof(reversed));
+  for (int t = 0; t < 60; t++) {
+    for (int n = rnd(8); n >= 0; n--) {
+      if (rnd(20) == 0) {
+        console.print("\x1b[2J");
+        memset(chars, ' ', sizeof(chars));
+        memset(reversed, 0, sizeof(reversed));
+        continue;
+      }
+      byte row = rnd(CONSOLE_ROWS), col = rnd(CONSOLE_COLS);
+      bool rev = rnd(4) == 0;
+      console.setCursor(row, col);
+      console.setReversed(rev);
+      for (byte len = rnd(CONSOLE_COLS - col) + 1; len > 0; len--, col++) {
+        char ch = rndRange(32, 123);
+        console.print(ch);
+        chars[row][col] = ch;
+        reversed[row][col] = rev;
+      }
+    }
+    // whatever text settings the sketch has, the cells are 5x7 at scale 1
+    if (rnd(2))
+      sDisplay.setPropFont(propFont);
+    sDisplay.setTextScale(rndRange(1, 4));
+    sDisplay.setTextMode(rnd(2));
+    sDisplay.setTextWrap(rnd(2));
+    nokiaTextStyle style = sDisplay.getTextStyle();
+    console.refresh();
+    if (!sameStyle(style, sDisplay.getTextStyle()))
+      bad++;
+    settle();
+    snapshot();
+
+    sModel.reset(); // nothing changed - nothing is sent
+    console.refresh();
+    settle();
+    if (sModel.dataBytes)
+      bad++;
+
+    sDisplay.clear();
+    sDisplay.resetTextStyle();
+    sDisplay.setTextWrap(false);
+    for (byte row = 0; row < CONSOLE_ROWS; row++)
+      for (byte col = 0; col < CONSOLE_COLS; col++) {
+        sDisplay.gotoXY(col * CONSOLE_CELL_WIDTH, row);
+        sDisplay.setTextMode(reversed[row][col]);
+        sDisplay.writeChar(chars[row][col]);
+      }
+    sDisplay.setTextMode(false);
+    sDisplay.setTextWrap(true);
+    settle();
+    bad += compare(sSnap);
+    console.invalidate(); // the screen was drawn over
+  }
+
+  // a print() after refresh() carries on from the sketch's cursor, not the console's last cell
+  console.print("console");
+  sDisplay.gotoXY(30, 4);
+  console.refresh();
+  if (sDisplay.cursorRow() != 4 || sDisplay.cursorCol() != 30)
+    bad++;
+  sDisplay.print('x');
+  settle();
+  for (int x = 0; x < 6; x++)
+    if (sModel.ram(30 + x, 4) != ((x < 5) ? smallFont[('x' - 32) * 5 + x] : 0))
+      bad++;
+  return bad + protocolErrors();
+}
+#endif // USE_PAGED_BUFFER
+
+#ifdef USE_SPRITES
+static unsigned int checkSprites(byte mode)
+{
+  static prog_char maps[LCD_MAX_SPRITES][64], masks[LCD_MAX_SPRITES][64];
+  static bool expected[LCD_X][LCD_Y];
+  struct { int x, y; byte w, h; bool visible, masked; } sprites[LCD_MAX_SPRITES];
+  unsigned int bad = 0;
+
+  start(mode);
+  memset(sprites, 0, sizeof(sprites));
+  for (byte n = 0; n < LCD_MAX_SPRITES; n++)
+    sDisplay.hideSprite(n);
+  sDisplay.updateSprites();
+
+  for (int t = 0; t < 3000; t++) {
+    byte r = rnd(10), n = rnd(LCD_MAX_SPRITES);
+    if (r == 0) { // the background changes under the sprites
+      if (rnd(2))
+        randomBlit(BLIT_XOR);
+      else
+        randomBankDrawing();
+    }
+    else if (r == 1) {
+      sprites[n].w = rndRange(1, 16);
+      sprites[n].h = rndRange(1, 20);
+      sprites[n].masked = rnd(2);
+      for (int i = 0; i < 64; i++) {
+        maps[n][i] = rnd(256);
+        masks[n][i] = rnd(256);
+      }
+      sDisplay.setSpriteP(n, maps[n], sprites[n].masked ? masks[n] : 0, sprites[n].w, sprites[n].h);
+    }
+    else if (r == 2) {
+      sprites[n].visible = false;
+      sDisplay.hideSprite(n);
+    }
+    else if (sprites[n].w) {
+      sprites[n].x = rndRange(-10, LCD_X + 10);
+      sprites[n].y = rndRange(-10, LCD_Y + 10);
+      sprites[n].visible = true;
+      sDisplay.moveSprite(n, sprites[n].x, sprites[n].y);
+    }
+    if (rnd(3) == 0)
+      sDisplay.updateSprites();
+
+    if (t % 53 == 0 || t == 2999) {
+      sDisplay.updateSprites();
+      settle();
+      memcpy(expected, sRef, sizeof(expected));
+      for (n = 0; n < LCD_MAX_SPRITES; n++) { // the higher numbers on top
+        if (!sprites[n].visible)
+          continue;
+        for (int j = 0; j < sprites[n].h; j++)
+          for (int i = 0; i < sprites[n].w; i++) {
+            int x = sprites[n].x + i, y = sprites[n].y + j, index = (j / 8) * sprites[n].w + i;
+            if (x < 0 || x >= LCD_X || y < 0 || y >= LCD_Y)
+              continue;
+            if (!sprites[n].masked || (((byte)masks[n][index] >> (j % 8)) & 1))
+              expected[x][y] = ((byte)maps[n][index] >> (j % 8)) & 1;
+          }
+      }
+      bad += compare(expected);
+    }
+  }
+  for (byte n = 0; n < LCD_MAX_SPRITES; n++)
+    sDisplay.hideSprite(n);
+  sDisplay.updateSprites();
+  return bad + protocolErrors();
+}
+
+#include "testing/animationTest.h"
+
+// the examples' animations end where the same picture drawn directly would
+static unsigned int checkAnimation(byte)
+{
+  unsigned int bad = 0;
+
+  start(DRAW_IMMEDIATE);
+  circle_animation();
+  snapshot();
+  sDisplay.clear();
+  sDisplay.gotoXY(0, 2);
+  sDisplay.print("Hello World!");
+  sDisplay.drawCircle(60, 20, 10, PIXEL_XOR);
+  bad += compare(sSnap);
+
+  sDisplay.clear();
+  sprite_animation();
+  snapshot();
+  sDisplay.clear();
+  sDisplay.gotoXY(0, 2);
+  sDisplay.print("Hello World!");
+  return bad + compare(sSnap) + protocolErrors();
+}
+#endif // USE_SPRITES
+
+#ifdef USE_PAGED_BUFFER
+// the same lines and rectangles every time - onto lcd, or onto the reference when lcd is 0
+static void seededShapes(nokiaDisplay* lcd)
+{
+  sSeed = 7;
+  for (int t = 0; t < 200; t++) {
+    byte x1 = rnd(LCD_X + 16), y1 = rnd(LCD_Y + 10), x2 = rnd(LCD_X + 16), y2 = rnd(LCD_Y + 10);
+    byte c = rnd(3);
+    bool line = rnd(2);
+    if (lcd && line)
+      lcd->drawLine(x1, y1, x2, y2, c);
+    else if (lcd)
+      lcd->drawFilledRectangle(x1, y1, x2, y2, c);
+    else if (line)
+      refLine(x1, y1, x2, y2, c);
+    else
+      refRectangle(x1, y1, x2, y2, c);
+  }
+}
+
+// and the same 200 blits over them
+static void seededBlits(nokiaDisplay* lcd)
+{
+  static byte map[4 * 255], mask[4 * 255];
+
+  sSeed = 11;
+  for (int t = 0; t < 200; t++) {
+    byte w = rndRange(1, 30), h = rndRange(1, 30), op = rnd(4);
+    int x = rndRange(-30, LCD_X + 10), y = rndRange(-30, LCD_Y + 10);
+    bool masked = rnd(2);
+    for (int i = 0; i < w * ((h + 7) / 8); i++) {
+      map[i] = rnd(256);
+      mask[i] = rnd(256);
+    }
+    if (lcd)
+      lcd->blit(x, y, map, w, h, op, masked ? mask : 0);
+    else
+      refBlit(x, y, map, w, h, op, masked ? mask : 0);
+  }
+}
+
+// a line of text over them, in whole banks
+static void pagedText(nokiaDisplay* lcd)
+{
+  const char* text = "Paged 0123";
+
+  if (lcd) {
+    lcd->gotoXY(3, 1);
+    lcd->print(text);
+    return;
+  }
+  for (int i = 0; text[i]; i++)
+    for (int gx = 0; gx < 6; gx++)
+      for (int gy = 0; gy < 8; gy++)
+        sRef[3 + i * 6 + gx][8 + gy] = refGlyphPixel(text[i], 1, false, gx, gy);
+}
+
+// renderPages() calls this once per bank
+static void pagedScene(nokiaDisplay& lcd)
+{
+  seededShapes(&lcd);
+  seededBlits(&lcd);
+  pagedText(&lcd);
+}
+
+static unsigned int checkPaged(byte)
+{
+  start(DRAW_DEFERRED);
+  sDisplay.renderPages(pagedScene);
+  seededShapes(0);
+  seededBlits(0);
+  pagedText(0);
+  return compare(sRef) + protocolErrors();
+}
+#endif // USE_PAGED_BUFFER
+
+#ifdef USE_STATS
+// the library's own byte counts against the bus
+static unsigned int checkStats(byte mode)
+{
+  start(mode);
+  sDisplay.resetStats();
+  sModel.reset();
+  for (int t = 0; t < 300; t++) {
+    randomPixels();
+    if (t % 50 == 0)
+      settle();
+  }
+  settle();
+  const nokiaLCDStats& stats = sDisplay.getStats();
+  return (stats.commandBytes != sModel.commandBytes) + (stats.dataBytes != sModel.dataBytes) +
+         protocolErrors();
+}
+#endif
+
+#ifdef USE_ASYNC_UPDATE
+static int sFlushes;
+static void countFlush() { sFlushes++; }
+
+// drawing goes on while the background update sends the last one
+static unsigned int checkBackground(byte)
+{
+  unsigned int bad = 0;
+  int updates = 0;
+
+  start(DRAW_DEFERRED);
+  sFlushes = 0;
+  sDisplay.setFlushCallback(countFlush);
+  for (int t = 0; t < 500; t++) {
+    randomPixels();
+    if (!sDisplay.isFlushing() && rnd(4) == 0) {
+      sDisplay.update();
+      updates++;
+    }
+    for (int k = rnd(20); k > 0; k--) {
+      if (sModel.canInterrupt())
+        sModel.raiseInterrupt();
+      else
+        sModel.timerInterrupt();
+    }
+  }
+  settle();
+  updates++;
+  sDisplay.setFlushCallback(0);
+  return bad + compare(sRef) + (sFlushes != updates) + protocolErrors();
+}
+
+// waitFlush() and updateStep() with the timer isr firing between their test of
+// the update and their step - when it sends the last byte, the update must
+// still end only once
+static unsigned int checkFlushRace(byte)
+{
+  int updates = 0;
+
+  start(DRAW_DEFERRED);
+  sFlushes = 0;
+  sDisplay.setFlushCallback(countFlush);
+  for (int t = 0; t < 300; t++) {
+    randomPixels();
+    if (rnd(2)) {
+      sDisplay.update();
+      sDisplay.waitFlush();
+    }
+    else
+      while (!sDisplay.updateStep(0))
+        if (sModel.canInterrupt())
+          sModel.raiseInterrupt();
+    updates++;
+  }
+  sDisplay.setFlushCallback(0);
+  return compare(sRef) + (sFlushes != updates) + protocolErrors();
+}
+#endif
+
+
+// ******************** running them ************************************************
+
+struct check {
+  const char* name;
+  unsigned int (*run)(byte mode);
+  bool bothModes; // run in DRAW_IMMEDIATE and in DRAW_DEFERRED
+};
+
+static const check sChecks[] = {
+#ifndef USE_PAGED_BUFFER
+  { "commands", checkCommands, false },
+  { "pixels", checkPixels, true },
+  { "blit", checkBlit, true },
+  { "shapes", checkShapes, true },
+  { "text", checkText, true },
+  { "propFont", checkPropFont, true },
+  { "scroll", checkScroll, true },
+  { "scheduler", checkScheduler, false },
+  { "console", checkConsole, true },
+#endif
+#ifdef USE_SPRITES
+  { "sprites", checkSprites, true },
+  { "animation", checkAnimation, false },
+#endif
+#ifdef USE_PAGED_BUFFER
+  { "paged", checkPaged, false },
+#endif
+#ifdef USE_STATS
+  { "stats", checkStats, true },
+#endif
+#ifdef USE_ASYNC_UPDATE
+  { "background", checkBackground, false },
+  { "flushRace", checkFlushRace, false },
+#endif
+};
+
+int main()
+{
+  unsigned int failed = 0;
+
+#ifdef USE_ASYNC_UPDATE
+  const byte transports = 2; // the mock's interrupt, then a timer calling flushStep()
+#else
+  const byte transports = 1;
+#endif
+
+  for (byte transport = 0; transport < transports; transport++) {
+#ifdef USE_ASYNC_UPDATE
+    sModel.setInterruptMode(transport == 0);
+    sModel.setTimer(transport == 0 ? 0 : &sDisplay);
+#endif
+    for (unsigned int i = 0; i < sizeof(sChecks) / sizeof(sChecks[0]); i++)
+      for (byte mode = 0; mode <= (sChecks[i].bothModes ? 1 : 0); mode++) {
+        sSeed = 1;
+        unsigned int bad = sChecks[i].run(sChecks[i].bothModes ? mode : DRAW_DEFERRED);
+        printf("%-10s %-9s %-9s %s", sChecks[i].name,
+               sChecks[i].bothModes ? (mode ? "deferred" : "immediate") : "",
+               transports == 1 ? "" : (transport ? "timer" : "interrupt"), bad ? "FAILED" : "ok");
+        if (bad)
+          printf(" (%u)", bad);
+        printf("\n");
+        failed += bad ? 1 : 0;
+      }
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Runs the DrawStuff and HelloWorld examples against the emulator, saves
+ * what the display would show and reports the bus traffic they cost.
+ *
+ *   ./emulate [output directory]
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "nokiaLCD.h"
+#include "pcd8544Emulator.h"
+
+static void report(const char* name, pcd8544Emulator& lcd)
+{
+  printf("%-12s cmd %5lu  data %5lu  selects %5lu  %9.0f us digitalWrite  %8.0f us port  %7.0f us spi  %s\n",
+         name, lcd.commandBytes, lcd.dataBytes, lcd.selects,
+         lcd.estimatedMicros(PCD8544_TIMING_DIGITALWRITE),
+         lcd.estimatedMicros(PCD8544_TIMING_PORT),
+         lcd.estimatedMicros(PCD8544_TIMING_SPI),
+         lcd.badCommands || lcd.unselectedBytes ? "PROTOCOL ERRORS" : "");
+}
+
+static void snapshot(pcd8544Emulator& lcd, const char* dir, const char* name)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "%s/%s.pbm", dir, name);
+  if (!lcd.writePBM(path))
+    fprintf(stderr, "can't write %s\n", path);
+}
+
+int main(int argc, char** argv)
+{
+  const char* dir = (argc > 1) ? argv[1] : ".";
+  pcd8544Emulator lcd;
+  nokiaDisplay display(lcd, 10, 6);
+
+  display.init();
+  report("init", lcd);
+
+  // examples/DrawStuff
+  lcd.resetCounters();
+  display.home();
+  display.drawCircle(48,24, 20,PIXEL_ON);
+  display.setPixel(44,15,PIXEL_ON);
+  display.setPixel(52,15,PIXEL_ON);
+  display.drawRectangle(40,30,56,35, PIXEL_ON);
+  display.update();
+  report("DrawStuff", lcd);
+  snapshot(lcd, dir, "drawstuff");
+
+  // examples/HelloWorld
+  display.clear();
+  lcd.resetCounters();
+  display.gotoXY(0,2);
+  display.print("Hello World!");
+  report("HelloWorld", lcd);
+  snapshot(lcd, dir, "helloworld");
+
+  return 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * PCD8544 emulator - see pcd8544Emulator.h
+ */
+
+#include <stdio.h>
+
+#include "pcd8544Emulator.h"
+
+// Estimates, counted by hand for an ATmega328 at -Os and not yet checked
+// against avr-gcc's output - `make avr-timing` counts them from a real
+// build, to replace these where they differ. A bit-bang bit is the test of data and a read-modify-write of sdin
+// (8 or 9 cycles), then sclk low and high (5 each); the rest of a byte is
+// the virtual call, loading the ports and masks and the SREG save. A select
+// is select(), setDC() and deselect() - for the SPI three digitalWrite()s.
+// digitalWrite() itself is assumed to be 56 cycles, so the DIGITALWRITE
+// and SPI select figures are only as good as that guess.
+const pcd8544Timing PCD8544_TIMING_DIGITALWRITE = { 16000000UL, 168, 39, 201 };
+const pcd8544Timing PCD8544_TIMING_PORT = { 16000000UL, 18, 39, 90 };
+const pcd8544Timing PCD8544_TIMING_SPI = { 16000000UL, 4, 18, 167 };
+
+
+pcd8544Emulator::pcd8544Emulator()
+{
+  reset();
+  resetCounters();
+  mSelected = false;
+  mDC = HIGH;
+}
+
+void pcd8544Emulator::reset()
+{
+  memset(mRam, 0, sizeof(mRam));
+  x = 0;
+  y = 0;
+  powerDown = true;
+  vertical = false;
+  extended = false;
+  displayMode = 0;
+  vop = 0;
+  bias = 0;
+  tempCoeff = 0;
+}
+
+void pcd8544Emulator::resetCounters()
+{
+  commandBytes = 0;
+  dataBytes = 0;
+  selects = 0;
+  dcChanges = 0;
+  unselectedBytes = 0;
+  badCommands = 0;
+}
+
+// nokiaDisplay::init() pulses reset just before it calls begin()
+void pcd8544Emulator::begin()
+{
+  reset();
+}
+
+void pcd8544Emulator::select()
+{
+  if (!mSelected)
+    selects++;
+  mSelected = true;
+}
+
+void pcd8544Emulator::deselect()
+{
+  mSelected = false;
+}
+
+void pcd8544Emulator::setDC(byte dc)
+{
+  if (dc != mDC)
+    dcChanges++;
+  mDC = dc;
+}
+
+void pcd8544Emulator::transfer(byte value)
+{
+  if (!mSelected) {
+    unselectedBytes++;
+    return;
+  }
+
+  if (mDC == LOW) {
+    commandBytes++;
+    command(value);
+  }
+  else {
+    dataBytes++;
+    data(value);
+  }
+}
+
+void pcd8544Emulator::command(byte cmd)
+{
+  if (cmd == 0x00) // nop
+    return;
+
+  if ((cmd & 0xf8) == 0x20) { // function set
+    powerDown = cmd & 0x04;
+    vertical = cmd & 0x02;
+    extended = cmd & 0x01;
+    return;
+  }
+
+  if (extended) {
+    if (cmd & 0x80)
+      vop = cmd & 0x7f;
+    else if ((cmd & 0xf8) == 0x10)
+      bias = cmd & 0x07;
+    else if ((cmd & 0xfc) == 0x04)
+      tempCoeff = cmd & 0x03;
+    else
+      badCommands++;
+    return;
+  }
+
+  if (cmd & 0x80) {
+    if ((cmd & 0x7f) < PCD8544_COLS)
+      x = cmd & 0x7f;
+    else
+      badCommands++;
+  }
+  else if ((cmd & 0xf8) == 0x40) {
+    if ((cmd & 0x07) < PCD8544_BANKS)
+      y = cmd & 0x07;
+    else
+      badCommands++;
+  }
+  else if ((cmd & 0xfa) == 0x08) // display control - D and E bits
+    displayMode = ((cmd & 0x04) >> 1) | (cmd & 0x01);
+  else
+    badCommands++;
+}
+
+void pcd8544Emulator::data(byte value)
+{
+  mRam[y][x] = value;
+
+  if (vertical) {
+    if (++y >= PCD8544_BANKS) {
+      y = 0;
+      if (++x >= PCD8544_COLS)
+        x = 0;
+    }
+  }
+  else {
+    if (++x >= PCD8544_COLS) {
+      x = 0;
+      if (++y >= PCD8544_BANKS)
+        y = 0;
+    }
+  }
+}
+
+bool pcd8544Emulator::pixel(byte px, byte py)
+{
+  if (px >= PCD8544_COLS || py >= PCD8544_ROWS || powerDown)
+    return false;
+
+  bool on = mRam[py / 8][px] & (1 << (py % 8));
+  switch (displayMode) {
+  case 0: return false;
+  case 1: return true;
+  case 2: return on;
+  default: return !on;
+  }
+}
+
+bool pcd8544Emulator::writePBM(const char* path)
+{
+  FILE* f = fopen(path, "w");
+  if (!f)
+    return false;
+
+  fprintf(f, "P1\n%d %d\n", PCD8544_COLS, PCD8544_ROWS);
+  for (byte py = 0; py < PCD8544_ROWS; py++) {
+    for (byte px = 0; px < PCD8544_COLS; px++)
+      fputc(pixel(px, py) ? '1' : '0', f);
+    fputc('\n', f);
+  }
+  return fclose(f) == 0;
+}
+
+double pcd8544Emulator::estimatedMicros(const pcd8544Timing& timing)
+{
+  double cycles = (double)(commandBytes + dataBytes) * (8.0 * timing.cyclesPerBit + timing.cyclesPerByte)
+                 + (double)selects * timing.cyclesPerSelect;
+  return cycles * 1000000.0 / timing.cpuHz;
+}
@@ -0,0 +1,88 @@
+/*
+ * PCD8544 emulator for host builds of the nokiaLCD library.
+ *
+ * It plugs in as the transport, so it sees exactly the D/C + byte stream
+ * that writeCommand()/writeData() produce, and runs it through a model of
+ * the controller: basic and extended instruction sets, horizontal and
+ * vertical addressing with auto increment, and the display modes.
+ * The 84x48 result can be read back a pixel at a time or saved as a PBM.
+ *
+ * It also counts the bus traffic and estimates how long it would have
+ * taken on a real board, given a clock and the cost of a bit and a byte.
+ */
+
+#ifndef pcd8544Emulator_h
+#define pcd8544Emulator_h
+
+#include "nokiaTransport.h"
+
+#define PCD8544_COLS  84
+#define PCD8544_BANKS 6
+#define PCD8544_ROWS  48
+
+// bus cost in cpu cycles, for the estimate of the transfer time.
+// Per bit, the fixed cost per byte (the calls), and per chip select
+// (select, D/C, deselect). The presets are instruction counts of the
+// ATmega328 code - see avrcycles.py
+struct pcd8544Timing {
+  unsigned long cpuHz;
+  unsigned int cyclesPerBit;
+  unsigned int cyclesPerByte;
+  unsigned int cyclesPerSelect;
+};
+
+extern const pcd8544Timing PCD8544_TIMING_DIGITALWRITE; // nokiaBitBang through digitalWrite
+extern const pcd8544Timing PCD8544_TIMING_PORT; // nokiaBitBang on cached port registers
+extern const pcd8544Timing PCD8544_TIMING_SPI; // nokiaHardwareSPI at fosc/4
+
+
+class pcd8544Emulator : public nokiaTransport {
+public:
+  pcd8544Emulator();
+
+  void reset(); // the reset pin - clears the ram and the registers
+  void resetCounters();
+
+  // the image as it would appear on the glass, honouring power down and the display mode
+  bool pixel(byte x, byte y);
+  byte ram(byte x, byte bank) { return mRam[bank][x]; }
+  bool writePBM(const char* path);
+
+  double estimatedMicros(const pcd8544Timing& timing);
+
+  // nokiaTransport
+  virtual void begin();
+  virtual void select();
+  virtual void deselect();
+  virtual void setDC(byte dc);
+  virtual void transfer(byte data);
+
+  // bus traffic
+  unsigned long commandBytes;
+  unsigned long dataBytes;
+  unsigned long selects; // chip select assertions
+  unsigned long dcChanges;
+  unsigned long unselectedBytes; // sent without chip select - lost on a real display
+  unsigned long badCommands; // undefined instructions and out of range addresses
+
+  // controller state
+  byte x;
+  byte y;
+  bool powerDown;
+  bool vertical; // vertical addressing
+  bool extended; // H - extended instruction set
+  byte displayMode; // 0 blank, 1 all on, 2 normal, 3 inverse
+  byte vop;
+  byte bias;
+  byte tempCoeff;
+
+private:
+  void command(byte cmd);
+  void data(byte value);
+
+  byte mRam[PCD8544_BANKS][PCD8544_COLS];
+  bool mSelected;
+  byte mDC;
+};
+
+#endif // pcd8544Emulator_h
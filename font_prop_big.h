@@ -0,0 +1,54 @@
+// Proportional 24 pixel font for NokiaLCD library - see setPropFont() and font_prop.h
+// the digits, '.', '+' and '-' of big_number_font (font_big.h) with their blank
+// columns trimmed, and a space. Anything else is drawn as a space - the chars
+// in between have a width of 0 and no glyph data.
+#include <avr/pgmspace.h>
+
+// 408 bytes - big_number_font is 624
+static const unsigned char bigNumFont[] PROGMEM =
+{
+      24, 32, 57, ' ', 4,   // header
+      0x06, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x60, 0x03, 0x8B, 0xAA, 0xAB, 0xAB, 0xBB,   // widths
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // space
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // '+'
+      0x40, 0x40, 0x40, 0x40, 0x40, 0xFE, 0xFE, 0x40, 0x40, 0x40, 0x40, 0x40,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00,   // '-'
+      0x40, 0x40, 0x40, 0x40, 0x40, 0x40,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00,   // '.'
+      0x00, 0x00, 0x00,
+      0x3C, 0x3C, 0x3C,
+      0x00, 0x80, 0xC0, 0xE0, 0xE0, 0x60, 0xE0, 0xE0, 0xC0, 0x80, 0x00,   // '0'
+      0x70, 0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFE,
+      0x00, 0x0F, 0x1F, 0x3C, 0x38, 0x30, 0x38, 0x38, 0x1F, 0x0F, 0x03,
+      0x00, 0x00, 0x80, 0xE0, 0xE0, 0x00, 0x00, 0x00,   // '1'
+      0x03, 0x03, 0x03, 0xFF, 0xFF, 0x00, 0x00, 0x00,
+      0x38, 0x38, 0x38, 0x3F, 0x3F, 0x38, 0x38, 0x38,
+      0xC0, 0xC0, 0xE0, 0x60, 0x60, 0xE0, 0xE0, 0xC0, 0x80, 0x00,   // '2'
+      0x01, 0x00, 0x00, 0x80, 0xC0, 0xE0, 0xF9, 0x3F, 0x1F, 0x00,
+      0x3C, 0x3E, 0x3F, 0x3F, 0x3B, 0x39, 0x38, 0x38, 0x38, 0x38,
+      0xC0, 0xE0, 0xE0, 0x60, 0x60, 0xE0, 0xE0, 0xC0, 0xC0, 0x00,   // '3'
+      0x01, 0x00, 0x00, 0x30, 0x30, 0x38, 0x7D, 0xEF, 0xCF, 0x00,
+      0x1C, 0x38, 0x38, 0x30, 0x30, 0x38, 0x3C, 0x1F, 0x0F, 0x01,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0xC0, 0xE0, 0xE0, 0x00, 0x00,   // '4'
+      0xE0, 0xF0, 0xF8, 0xDE, 0xCF, 0xC7, 0xC1, 0xFF, 0xFF, 0xC0, 0xC0,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3F, 0x3F, 0x00, 0x00,
+      0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0,   // '5'
+      0x3F, 0x3F, 0x3F, 0x38, 0x38, 0x30, 0x70, 0xF0, 0xE0, 0x00,
+      0x1C, 0x38, 0x38, 0x30, 0x30, 0x38, 0x3C, 0x1F, 0x0F, 0x01,
+      0x00, 0x00, 0x80, 0xC0, 0xC0, 0xE0, 0x60, 0x60, 0xE0, 0xE0, 0x00,   // '6'
+      0xE0, 0xFE, 0xFF, 0x37, 0x39, 0x18, 0x18, 0x38, 0xF0, 0xF0, 0xC0,
+      0x00, 0x0F, 0x1F, 0x1C, 0x38, 0x30, 0x30, 0x38, 0x1F, 0x0F, 0x07,
+      0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0, 0xE0,   // '7'
+      0x00, 0x00, 0x00, 0x80, 0xE0, 0xF8, 0x7E, 0x1F, 0x07, 0x01,
+      0x00, 0x38, 0x3E, 0x1F, 0x07, 0x01, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x80, 0xC0, 0xE0, 0xE0, 0x60, 0x60, 0xE0, 0xC0, 0xC0, 0x00,   // '8'
+      0x00, 0xCF, 0xFF, 0x7F, 0x38, 0x30, 0x70, 0x70, 0xFF, 0xEF, 0xC7,
+      0x03, 0x0F, 0x1F, 0x3C, 0x38, 0x30, 0x30, 0x38, 0x1F, 0x1F, 0x0F,
+      0x00, 0x80, 0xC0, 0xE0, 0xE0, 0x60, 0xE0, 0xE0, 0xC0, 0x80, 0x00,   // '9'
+      0x0C, 0x3F, 0x7F, 0xF1, 0xE0, 0xC0, 0xC0, 0xE1, 0xFF, 0xFF, 0xFE,
+      0x00, 0x00, 0x38, 0x30, 0x30, 0x38, 0x38, 0x1E, 0x0F, 0x07, 0x00
+};
@@ -0,0 +1,278 @@
+/*
+ * A text console over nokiaLCD - see nokiaConsole.h
+ */
+
+#include <string.h>
+
+#include "nokiaConsole.h"
+
+// mAttrs bits
+#define CELL_REVERSED 0x01
+#define CELL_DIRTY    0x80
+
+// mEscape states
+#define ESC_NONE  0
+#define ESC_START 1 // had the ESC
+#define ESC_CSI   2 // had ESC [ - reading the parameters
+
+
+nokiaConsole::nokiaConsole(nokiaDisplay& lcd)
+  : mLcd(lcd), mRow(0), mCol(0), mAttr(0), mEscape(ESC_NONE)
+{
+  memset(mChars, ' ', sizeof(mChars));
+  memset(mAttrs, 0, sizeof(mAttrs));
+  invalidate(); // what is on the screen is not known
+}
+
+/*
+ * Name         : clear
+ * Description  : Blank every cell and send the cursor home. Only the cells
+ *                that were not blank already are sent by the next refresh().
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaConsole::clear()
+{
+  for (byte row = 0; row < CONSOLE_ROWS; row++)
+    clearCells(row, 0, CONSOLE_COLS - 1);
+  mRow = 0;
+  mCol = 0;
+}
+
+void nokiaConsole::setCursor(byte row, byte col)
+{
+  mRow = (row < CONSOLE_ROWS) ? row : CONSOLE_ROWS - 1;
+  mCol = (col < CONSOLE_COLS) ? col : CONSOLE_COLS - 1;
+}
+
+void nokiaConsole::setReversed(bool reversed)
+{
+  mAttr = reversed ? CELL_REVERSED : 0;
+}
+
+void nokiaConsole::invalidate()
+{
+  for (byte row = 0; row < CONSOLE_ROWS; row++)
+    for (byte col = 0; col < CONSOLE_COLS; col++)
+      mAttrs[row][col] |= CELL_DIRTY;
+}
+
+/*
+ * Name         : refresh
+ * Description  : Draw the changed cells. Each run of changed cells on a row
+ *                gets one gotoXY() - the chars after the first follow on from
+ *                the controller's address counter - and the whole refresh is
+ *                one transaction. The cells are drawn in the 5x7 font at scale 1
+ *                whatever the display was set to, and its text settings and
+ *                text cursor are put back afterwards.
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaConsole::refresh()
+{
+  nokiaTransaction transaction(mLcd);
+  nokiaTextStyle style = mLcd.getTextStyle();
+  byte cursorRow = mLcd.cursorRow(), cursorCol = mLcd.cursorCol();
+  bool drawn = false;
+  byte row, col;
+
+  mLcd.resetTextStyle();
+  mLcd.setTextWrap(false); // the last cell ends right on the edge of the screen
+  for (row = 0; row < CONSOLE_ROWS; row++) {
+    col = 0;
+    while (col < CONSOLE_COLS) {
+      if (!(mAttrs[row][col] & CELL_DIRTY)) {
+        col++;
+        continue;
+      }
+
+      mLcd.gotoXY(col * CONSOLE_CELL_WIDTH, row);
+      drawn = true;
+      while (col < CONSOLE_COLS && (mAttrs[row][col] & CELL_DIRTY)) {
+        mLcd.setTextMode(mAttrs[row][col] & CELL_REVERSED);
+        mLcd.writeChar(mChars[row][col]);
+        mAttrs[row][col] &= ~CELL_DIRTY;
+        col++;
+      }
+    }
+  }
+  mLcd.setTextStyle(style);
+  if (drawn)
+    mLcd.gotoXY(cursorCol, cursorRow); // so print() carries on where it was
+}
+
+/*
+ * Name         : write
+ * Description  : A char from Print - put in the next cell, or a control char
+ *                or part of an escape sequence
+ * Argument(s)  : character - char to write
+ * Return value : 1
+ */
+#if defined(ARDUINO) && ARDUINO >= 100
+size_t nokiaConsole::write(byte character)
+#else
+void nokiaConsole::write(byte character)
+#endif
+{
+  switch (mEscape) {
+  case ESC_NONE:
+    if (character == 0x1b)
+      mEscape = ESC_START;
+    else
+      putChar(character);
+    break;
+
+  case ESC_START:
+    mEscape = ESC_NONE; // only CSI sequences are understood
+    if (character == '[') {
+      mEscape = ESC_CSI;
+      mParams[0] = 0;
+      mParams[1] = 0;
+      mParamCount = 0;
+    }
+    break;
+
+  case ESC_CSI:
+    if (character >= '0' && character <= '9') {
+      if (mParamCount == 0)
+        mParamCount = 1;
+      if (mParamCount <= 2) {
+        byte* p = &mParams[mParamCount - 1];
+        *p = (*p < 25) ? *p * 10 + (character - '0') : 255;
+      }
+    }
+    else if (character == ';') {
+      if (mParamCount == 0)
+        mParamCount = 1; // empty first parameter
+      if (mParamCount <= 2)
+        mParamCount++;
+    }
+    else if (character >= 0x40 && character <= 0x7e) {
+      mEscape = ESC_NONE;
+      escape(character);
+    }
+    break; // anything else, e.g. the ? of private modes, is skipped
+  }
+#if defined(ARDUINO) && ARDUINO >= 100
+  return 1;
+#endif
+}
+
+void nokiaConsole::putChar(byte ch)
+{
+  switch (ch) {
+  case '\r':
+    mCol = 0;
+    break;
+  case '\n':
+    lineFeed();
+    break;
+  case '\b':
+    if (mCol > 0)
+      mCol--;
+    break;
+  default:
+    if (ch < ' ')
+      break; // other control chars
+    if (mCol >= CONSOLE_COLS) { // wrap when there is something to put on the next line
+      mCol = 0;
+      lineFeed();
+    }
+    setCell(mRow, mCol, ch, mAttr);
+    mCol++;
+  }
+}
+
+/*
+ * Name         : setCell
+ * Description  : Change a cell, marking it dirty unless it already holds the
+ *                same char with the same attributes
+ * Argument(s)  : row, col - the cell
+ *                ch - char
+ *                attr - CELL_REVERSED or 0
+ * Return value : none
+ */
+void nokiaConsole::setCell(byte row, byte col, byte ch, byte attr)
+{
+  if (mChars[row][col] == (char)ch && (mAttrs[row][col] & CELL_REVERSED) == attr)
+    return;
+  mChars[row][col] = ch;
+  mAttrs[row][col] = attr | CELL_DIRTY;
+}
+
+void nokiaConsole::clearCells(byte row, byte col1, byte col2)
+{
+  for (byte col = col1; col <= col2; col++)
+    setCell(row, col, ' ', 0);
+}
+
+// down a row - or on the bottom row, scroll the cells up one
+void nokiaConsole::lineFeed()
+{
+  if (mRow < CONSOLE_ROWS - 1) {
+    mRow++;
+    return;
+  }
+
+  for (byte row = 0; row < CONSOLE_ROWS - 1; row++)
+    for (byte col = 0; col < CONSOLE_COLS; col++)
+      setCell(row, col, mChars[row + 1][col], mAttrs[row + 1][col] & CELL_REVERSED);
+  clearCells(CONSOLE_ROWS - 1, 0, CONSOLE_COLS - 1);
+}
+
+/*
+ * Name         : escape
+ * Description  : Carry out a CSI sequence - see nokiaConsole.h for the list
+ * Argument(s)  : final - the letter that ended it
+ * Return value : none
+ */
+void nokiaConsole::escape(byte final)
+{
+  byte n = mParams[0] ? mParams[0] : 1; // count for the moves
+  byte row, i;
+
+  switch (final) {
+  case 'H':
+  case 'f':
+    setCursor(n - 1, (mParams[1] ? mParams[1] : 1) - 1);
+    break;
+  case 'A':
+    mRow = (mRow > n) ? mRow - n : 0;
+    break;
+  case 'B':
+    setCursor((mRow + n < CONSOLE_ROWS) ? mRow + n : CONSOLE_ROWS - 1, mCol);
+    break;
+  case 'C':
+    setCursor(mRow, (mCol + n < CONSOLE_COLS) ? mCol + n : CONSOLE_COLS - 1);
+    break;
+  case 'D':
+    mCol = (mCol > n) ? mCol - n : 0;
+    break;
+
+  case 'J': // 0 - cursor to the end, 1 - start to the cursor, 2 - all
+    for (row = 0; row < CONSOLE_ROWS; row++) {
+      if (mParams[0] == 2 || (mParams[0] == 0 && row > mRow) || (mParams[0] == 1 && row < mRow))
+        clearCells(row, 0, CONSOLE_COLS - 1);
+    }
+    // and the cursor's own line as for K
+    // fall through
+  case 'K':
+    if (mParams[0] == 0 && mCol < CONSOLE_COLS)
+      clearCells(mRow, mCol, CONSOLE_COLS - 1);
+    else if (mParams[0] == 1)
+      clearCells(mRow, 0, (mCol < CONSOLE_COLS) ? mCol : CONSOLE_COLS - 1);
+    else if (mParams[0] == 2)
+      clearCells(mRow, 0, CONSOLE_COLS - 1);
+    break;
+
+  case 'm':
+    n = mParamCount ? mParamCount : 1;
+    for (i = 0; i < n && i < 2; i++) {
+      if (mParams[i] == 0 || mParams[i] == 27)
+        mAttr = 0;
+      else if (mParams[i] == 7)
+        mAttr = CELL_REVERSED;
+    }
+    break;
+  }
+}
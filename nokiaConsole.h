@@ -0,0 +1,94 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/**
+A text console over nokiaLCD - a grid of character cells (14x6 on the
+5110) in the default 5x7 font. Printing only changes the cells; refresh()
+sends the cells that now differ from what is on the screen, each run of
+neighbouring changed cells with one address and one burst of data. A
+status screen that prints the same labels every loop sends next to
+nothing.
+
+A small part of ANSI/VT100 is understood, so the same output can go to
+the console or to a serial terminal:
+  ESC[row;colH  ESC[row;colf  cursor to row, col (from 1)
+  ESC[nA ESC[nB ESC[nC ESC[nD  cursor up, down, right, left
+  ESC[J ESC[1J ESC[2J         clear to the end, from the start, all of the screen
+  ESC[K ESC[1K ESC[2K         the same for the cursor's line
+  ESC[7m ESC[27m ESC[0m       reversed on, off, normal
+and \r, \n and \b. A line feed on the bottom line scrolls the cells up.
+Other escapes are read and ignored.
+
+The console owns the display's text settings while it refreshes - it draws
+in the 5x7 font at scale 1, and the font, scale, text mode and wrap set
+before refresh() are back afterwards, as is the display's text cursor.
+In deferred mode refresh() only fills the screen buffer, for the next
+update().
+*/
+
+#ifndef nokiaConsole_h
+#define nokiaConsole_h
+
+#include "nokiaLCD.h"
+
+#define CONSOLE_CELL_WIDTH 6 // 5x7 font and a blank column
+#define CONSOLE_COLS (LCDCOLMAX / CONSOLE_CELL_WIDTH)
+#define CONSOLE_ROWS LCDROWMAX
+
+
+class nokiaConsole : public Print {
+public:
+  nokiaConsole(nokiaDisplay& lcd);
+
+  void clear(); // all cells blank, cursor home
+  void setCursor(byte row, byte col); // row: 0-5, col: 0-13
+  void setReversed(bool reversed); // for the chars that follow - like nokiaDisplay::setTextMode()
+  void refresh(); // send the changed cells
+  void invalidate(); // make the next refresh() send every cell
+
+  byte cursorRow() { return mRow; }
+  byte cursorCol() { return mCol; }
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  virtual size_t write(byte character);
+#else
+  virtual void write(byte character);
+#endif
+  using Print::write;
+
+private:
+  void putChar(byte ch);
+  void setCell(byte row, byte col, byte ch, byte attr);
+  void clearCells(byte row, byte col1, byte col2);
+  void lineFeed();
+  void escape(byte final);
+
+  nokiaDisplay& mLcd;
+
+  char mChars[CONSOLE_ROWS][CONSOLE_COLS];
+  byte mAttrs[CONSOLE_ROWS][CONSOLE_COLS]; // CELL_REVERSED, CELL_DIRTY
+  byte mRow;
+  byte mCol;
+  byte mAttr; // for the chars that follow
+
+// escape sequence being read
+  byte mEscape;
+  byte mParams[2];
+  byte mParamCount;
+};
+
+#endif // nokiaConsole_h
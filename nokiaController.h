@@ -0,0 +1,197 @@
+/*
+ * Display controllers for the nokiaLCD library.
+ *
+ * Pick the controller (and so the geometry) at compile time by defining
+ * LCD_CONTROLLER - here or with a build flag. LCD_X / LCD_Y can also be
+ * overridden for a panel that uses less than the controller's ram.
+ *
+ * The geometry is set by the #if on LCD_CONTROLLER below. Everything else
+ * that differs - the init sequence, the address commands and the address
+ * counter - is a traits struct of inline functions, typedef'd to
+ * nokiaController at the bottom, so nothing is decided at run time: the
+ * 84x48 PCD8544 build is the same code as before.
+ */
+
+#ifndef nokiaController_h
+#define nokiaController_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include <WConstants.h> // wiring.h
+#endif
+
+#define LCD_PCD8544 1 // nokia 5110 / 3310 - 84x48
+#define LCD_PCF8812 2 // PCD8544 instruction set, 102x64
+#define LCD_ST7565  3 // ST7565 / UC1701 page addressed - 128x64
+
+#ifndef LCD_CONTROLLER
+#define LCD_CONTROLLER LCD_PCD8544
+#endif
+
+#if LCD_CONTROLLER == LCD_PCD8544
+  #ifndef LCD_X
+  #define LCD_X 84
+  #endif
+  #ifndef LCD_Y
+  #define LCD_Y 48
+  #endif
+#elif LCD_CONTROLLER == LCD_PCF8812
+  #ifndef LCD_X
+  #define LCD_X 102
+  #endif
+  #ifndef LCD_Y
+  #define LCD_Y 64
+  #endif
+#elif LCD_CONTROLLER == LCD_ST7565
+  #ifndef LCD_X
+  #define LCD_X 128
+  #endif
+  #ifndef LCD_Y
+  #define LCD_Y 64
+  #endif
+#else
+  #error unknown LCD_CONTROLLER
+#endif
+
+#define LCDCOLMAX	LCD_X
+#define LCDROWMAX	((LCD_Y + 7) / 8)
+#define LCDPIXELROWMAX	LCD_Y
+
+#define LCD_ADDR_UNKNOWN 0xff
+
+
+// PCD8544 and PCF8812: 0x80|x and 0x40|y in the basic instruction set (H = 0),
+// horizontal addressing wraps x into the next bank at the end of the ram row
+template<byte RAM_COLS, byte RAM_BANKS>
+struct nokiaPCD8544Traits {
+  // state is the last function set cmd - the H and V bits
+  static byte initialState() { return 0x20; }
+
+  // after the hardware reset - lcd is the nokiaDisplay
+  template<class LCD>
+  static void init(LCD& lcd)
+  {
+    lcd.writeCommand(0x21);  // LCD Extended Commands
+    //lcd.writeCommand(0xC0); 	// Set LCD Vop (Contrast) **NEW**
+    lcd.writeCommand(0xc9); // attiny evil-genius puts it at 0xd3
+    lcd.writeCommand(0x06);  // Set temp coefficient   **NEW**
+    lcd.writeCommand(0x13);  // LCD bias mode1:48
+    lcd.writeCommand(0x20);  // LCD Standard Commands, Horizontal addressing mode
+    // these next 2 cmds are from TinyAVR for the Evil Genius - do we need?
+  //  lcd.writeCommand(0x09); // activate all segments
+    lcd.clear();
+  //  lcd.writeCommand(0x08); // clear the display
+    lcd.writeCommand(0x0c);  // LCD in normal mode
+  }
+
+  static byte columnCommands(byte x, byte* cmds) { cmds[0] = 0x80 | x; return 1; }
+  static byte bankCommand(byte y) { return 0x40 | y; }
+
+  // follow a command into the address counter
+  static void trackCommand(byte cmd, byte& x, byte& y, byte& state)
+  {
+    if ((cmd & 0xf8) == 0x20) { // function set - H & V bits
+      state = cmd;
+    }
+    else if (!(state & 0x01)) { // basic instruction set
+      if (cmd & 0x80)
+        x = cmd & 0x7f;
+      else if ((cmd & 0xf0) == 0x40)
+        y = cmd & 0x0f;
+    }
+  }
+
+  // step the address counter past a data byte
+  static void advance(byte& x, byte& y, byte state)
+  {
+    if (state & 0x02) { // vertical addressing isn't followed
+      x = LCD_ADDR_UNKNOWN;
+      y = LCD_ADDR_UNKNOWN;
+    }
+    else if (++x >= RAM_COLS) {
+      x = 0;
+      if (y != LCD_ADDR_UNKNOWN && ++y >= RAM_BANKS)
+        y = 0;
+    }
+  }
+};
+
+
+// ST7565 / UC1701: 0xb0|page, then the column in two nibbles (0x10|hi, 0x00|lo).
+// The column counts up on each data byte and stops at the end of the page
+#define ST7565_VALUE_DUE 0x80 // in the state - the next command byte is a value
+
+struct nokiaST7565Traits {
+  // state is the last column high nibble, plus ST7565_VALUE_DUE after the
+  // first byte of a two byte command
+  static byte initialState() { return 0; }
+
+  // typical ST7565/UC1701 module - the bias, scan directions and contrast depend on the glass
+  template<class LCD>
+  static void init(LCD& lcd)
+  {
+    lcd.writeCommand(0xe2);  // internal reset
+    lcd.writeCommand(0xa2);  // bias 1/9
+    lcd.writeCommand(0xa0);  // column (segment) scan normal
+    lcd.writeCommand(0xc8);  // row (common) scan reversed
+    lcd.writeCommand(0x2f);  // booster, regulator & follower on
+    lcd.writeCommand(0x26);  // regulator resistor ratio
+    lcd.writeCommand(0x81);  // contrast ...
+    lcd.writeCommand(0x10);  // ... value
+    lcd.writeCommand(0x40);  // display start line 0
+    lcd.clear();
+    lcd.writeCommand(0xaf);  // display on
+  }
+
+  static byte columnCommands(byte x, byte* cmds)
+  {
+    cmds[0] = 0x10 | (x >> 4);
+    cmds[1] = 0x00 | (x & 0x0f);
+    return 2;
+  }
+  static byte bankCommand(byte y) { return 0xb0 | y; }
+
+  static void trackCommand(byte cmd, byte& x, byte& y, byte& state)
+  {
+    if (state & ST7565_VALUE_DUE) { // e.g. the contrast after 0x81 - not an opcode
+      state &= ~ST7565_VALUE_DUE;
+      return;
+    }
+
+    if (cmd == 0x81 || cmd == 0xf8 || cmd == 0xac || cmd == 0xad) // contrast, booster, static indicator
+      state |= ST7565_VALUE_DUE;
+    else if ((cmd & 0xf0) == 0xb0)
+      y = cmd & 0x0f;
+    else if ((cmd & 0xf0) == 0x10) {
+      state = cmd & 0x0f;
+      if (x != LCD_ADDR_UNKNOWN)
+        x = (state << 4) | (x & 0x0f);
+    }
+    else if ((cmd & 0xf0) == 0x00)
+      x = (state << 4) | cmd;
+    else if (cmd == 0xe2) { // reset
+      x = LCD_ADDR_UNKNOWN;
+      y = LCD_ADDR_UNKNOWN;
+    }
+    else if (cmd == 0xee) // end of read-modify-write - the column goes back to where it began
+      x = LCD_ADDR_UNKNOWN;
+  }
+
+  static void advance(byte& x, byte&, byte)
+  {
+    if (++x >= LCD_X) // past the visible columns - don't guess
+      x = LCD_ADDR_UNKNOWN;
+  }
+};
+
+
+#if LCD_CONTROLLER == LCD_PCD8544
+typedef nokiaPCD8544Traits<84, 6> nokiaController;
+#elif LCD_CONTROLLER == LCD_PCF8812
+typedef nokiaPCD8544Traits<102, 9> nokiaController;
+#elif LCD_CONTROLLER == LCD_ST7565
+typedef nokiaST7565Traits nokiaController;
+#endif
+
+#endif // nokiaController_h
@@ -19,27 +19,68 @@
 #define LCD_CMD     LOW
 #define LCD_DATA     HIGH
 
+// each bit of a nibble repeated 2, 3 or 4 times - for setTextScale()
+static const uint16_t sSpreadNibble[3][16] PROGMEM = {
+  { 0x0000, 0x0003, 0x000c, 0x000f, 0x0030, 0x0033, 0x003c, 0x003f, 0x00c0, 0x00c3, 0x00cc, 0x00cf, 0x00f0, 0x00f3, 0x00fc, 0x00ff }, // x2
+  { 0x0000, 0x0007, 0x0038, 0x003f, 0x01c0, 0x01c7, 0x01f8, 0x01ff, 0x0e00, 0x0e07, 0x0e38, 0x0e3f, 0x0fc0, 0x0fc7, 0x0ff8, 0x0fff }, // x3
+  { 0x0000, 0x000f, 0x00f0, 0x00ff, 0x0f00, 0x0f0f, 0x0ff0, 0x0fff, 0xf000, 0xf00f, 0xf0f0, 0xf0ff, 0xff00, 0xff0f, 0xfff0, 0xffff }, // x4
+};
 
 
 
-nokiaLCD::nokiaLCD(byte res, byte dc, byte sdin, byte sclk, byte sce, byte led)
-  : mPin_reset(res), mPin_dc(dc), mPin_sdin(sdin), mPin_sclk(sclk), mPin_sce(sce), mPin_led(led),
-    mFont(smallFont), mFontWidth(5), mNormalMode(true), mWrapText(true)
-{}
+
+nokiaDisplay::nokiaDisplay(nokiaTransport& transport, byte res, byte led)
+  : mTransport(&transport), mPin_reset(res), mPin_led(led),
+    mFont(smallFont), mFontWidth(5), mFontLast(123), mPropFont(0), mFontBanks(1), mTextScale(1), mNormalMode(true), mWrapText(true)
+{
+  setup();
+}
+
+// constructor code
+void nokiaDisplay::setup()
+{
+#ifdef USE_GRAPHIC
+  mDrawMode = DRAW_IMMEDIATE;
+#endif
+#ifdef USE_PAGED_BUFFER
+  mPage = LCD_ADDR_UNKNOWN;
+#elif defined(USE_GRAPHIC)
+  for (byte row = 0; row < LCDROWMAX; row++)
+    markClean(row); // clear() in init() does it too, but deferred drawing may come first
+  mTerminal = false;
+  mStepRow = 0;
+  mStepCol = 0;
+#endif
+#ifdef USE_SPRITES
+  for (byte n = 0; n < LCD_MAX_SPRITES; n++) {
+    mSprites[n].flags = 0;
+    mSpritesNext[n].flags = 0;
+  }
+#endif
+  mControllerState = nokiaController::initialState();
+  mAddrX = LCD_ADDR_UNKNOWN;
+  mAddrY = LCD_ADDR_UNKNOWN;
+  mElidedCommands = 0;
+  mTransactions = 0;
+  mSelected = false;
+  mDC = LCD_ADDR_UNKNOWN;
+#ifdef USE_STATS
+  resetStats();
+#endif
+#ifdef USE_ASYNC_UPDATE
+  mFlushing = false;
+  mFlushBusy = false;
+  mFlushCallback = 0;
+#endif
+}
 
 /**
  * call this in your setup func - not before!!
 */
-void nokiaLCD::init()
+void nokiaDisplay::init()
 {
-  pinMode(mPin_sce, OUTPUT);
-  pinMode(mPin_reset, OUTPUT);
-  pinMode(mPin_dc, OUTPUT);
-  pinMode(mPin_sdin, OUTPUT);
-  pinMode(mPin_sclk, OUTPUT);
-  if (mPin_led >= 0) {
-      pinMode(mPin_led, OUTPUT);
-  }
+  nokiaTransaction transaction(*this);
+  beginPins();
 
   // this init code is from itead studio for their keyboard/display shield -
   // http://iteadstudio.com/store/index.php?main_page=product_info&cPath=18&products_id=308
@@ -50,31 +91,28 @@ void nokiaLCD::init()
 //stabilize, lower reset, delay by ~1uS (1 nop @ 8MHz will do), raise reset then send it the initialization sequence above.
 
 
-  // set the data pins high -
+  // set the data pins high (the transport does its own) -
   // for some reason, this must be done first before the reset sequence in order for the sce pin to be optional (gnd)
-  digitalWrite(mPin_reset, HIGH);
-  digitalWrite(mPin_dc, HIGH);
-  digitalWrite(mPin_sdin, HIGH); // mo
-  digitalWrite(mPin_sclk, HIGH); // sck
-  digitalWrite(mPin_sce, HIGH); // cs
+  writeReset(HIGH);
+  mTransport->begin();
+  mSelected = false;
+  mDC = LCD_ADDR_UNKNOWN; // whatever begin() left it at
+#ifdef USE_ASYNC_UPDATE
+  // not in the constructor - the transport may not have been constructed yet (see nokiaLCD)
+  mTransport->onComplete(flushComplete, this);
+#endif
   delay(5);
 
   // now reset the display
-  digitalWrite(mPin_reset, LOW);
+  writeReset(LOW);
   delayMicroseconds(20);
-  digitalWrite(mPin_reset, HIGH);
+  writeReset(HIGH);
+
+  mControllerState = nokiaController::initialState();
+  mAddrX = LCD_ADDR_UNKNOWN; // don't trust the address until it has been set
+  mAddrY = LCD_ADDR_UNKNOWN;
 
-  writeCommand(0x21);  // LCD Extended Commands
-  //writeCommand(0xC0); 	// Set LCD Vop (Contrast) **NEW**
-  writeCommand(0xc9); // attiny evil-genius puts it at 0xd3
-  writeCommand(0x06);  // Set temp coefficient   **NEW**
-  writeCommand(0x13);  // LCD bias mode1:48
-  writeCommand(0x20);  // LCD Standard Commands, Horizontal addressing mode
-  // these next 2 cmds are from TinyAVR for the Evil Genius - do we need?
-//  writeCommand(0x09); // activate all segments
-  clear();
-//  writeCommand(0x08); // clear the display
-  writeCommand(0x0c);  // LCD in normal mode
+  nokiaController::init(*this);
 }
 
 
@@ -86,53 +124,65 @@ void nokiaLCD::init()
  * Argument(s)  : none
  * Return value : none
  */
-void nokiaLCD::clear()
+void nokiaDisplay::clear()
 {
+  nokiaTransaction transaction(*this);
+#ifdef USE_PAGED_BUFFER
+  if (mPage != LCD_ADDR_UNKNOWN)
+    fillArea(0, 0, LCDCOLMAX - 1, LCDPIXELROWMAX - 1, PIXEL_OFF); // inside renderPages()
+  else {
+    setAddress(0, 0); // no buffer to clear - blank the display itself
+    for(unsigned int i=0; i< LCDROWMAX * LCDCOLMAX; i++)
+      writeData(0x00);
+  }
+#elif defined(USE_GRAPHIC)
+  fillArea(0, 0, LCDCOLMAX - 1, LCDPIXELROWMAX - 1, PIXEL_OFF);
+#else
 	home();  	//start with (0,0) home position
 
 	for(byte i=0; i< LCDROWMAX; i++) {
 		for(byte j=0; j< LCDCOLMAX; j++)
     {
       writeData(0x00);
-#ifdef USE_GRAPHIC
-    	mBuffer[i][j] = 0x00;
-#endif
     }
   }
+#endif
   home(); //bring the XY position back to (0,0)
 }
 
-void nokiaLCD::clearLine()
+void nokiaDisplay::clearLine()
 {
+  nokiaTransaction transaction(*this);
   byte line = 	mCursorRow;
+#ifdef USE_GRAPHIC
+  fillArea(0, line * 8, LCDCOLMAX - 1, line * 8 + 7, PIXEL_OFF);
+#else
 	gotoLine(line);
 
 		for(byte j=0; j< LCDCOLMAX; j++)
     {
       writeData(0x00);
-#ifdef USE_GRAPHIC
-    	mBuffer[line][j] = 0x00;
-#endif
     }
+#endif
 	gotoLine(line);
 }
 
-void nokiaLCD::home()
+void nokiaDisplay::home()
 {
   gotoXY(0,0);
 }
 
-void nokiaLCD::setCursor(byte row, byte col)
+void nokiaDisplay::setCursor(byte row, byte col)
 {
-  gotoXY(col*(mFontWidth+1), row);
+  gotoXY(col*(mFontWidth+1)*mTextScale, row);
 }
 
-void nokiaLCD::gotoLine(byte line)
+void nokiaDisplay::gotoLine(byte line)
 {
   gotoXY(mCursorCol, line); // don't want to prescale the col - leave it like it is
 }
 
-void nokiaLCD::gotoCol(byte col)
+void nokiaDisplay::gotoCol(byte col)
 {
   setCursor(mCursorRow, col);
 }
@@ -140,25 +190,93 @@ void nokiaLCD::gotoCol(byte col)
 
 /*
  * Name         : gotoXY
- * Description  : Move text position cursor to specified position
+ * Description  : Move text position cursor to specified position.
+ *                In deferred mode only the cursor moves - nothing is sent.
  * Argument(s)  : x, y - Position, x = 0-83, y = 0-6
  * Return value : none
  */
-void nokiaLCD::gotoXY(byte x, byte y)
+void nokiaDisplay::gotoXY(byte x, byte y)
 {
   if (x > LCDCOLMAX - 1) x = LCDCOLMAX - 1 ; // ensure within limits
   if (y > LCDROWMAX - 1) y = LCDROWMAX - 1 ; // ensure within limits
 
-  writeCommand(0x80 | x);  // Column.
-  writeCommand(0x40 | y);  // Row.
+#ifdef USE_STATS
+  mStats.gotoXYs++;
+#endif
+  if (!isDeferred())
+    setAddress(x, y);
 
 	mCursorRow = y;
 	mCursorCol = x;
 
 }
 
-void nokiaLCD::backlight(byte level)
+/*
+ * Name         : setAddress
+ * Description  : Set the display ram address for the next data byte.
+ *                A command is only sent if the controller's address counter
+ *                isn't already there (see writeCommand & writeData).
+ * Argument(s)  : x, y - Position, x = 0-83, y = 0-5
+ * Return value : none
+ */
+void nokiaDisplay::setAddress(byte x, byte y)
+{
+#ifdef USE_ASYNC_UPDATE
+  waitFlush(); // the background update moves the address too
+#endif
+  byte cmds[2];
+  byte i, n;
+
+  if (x != mAddrX) {
+    n = nokiaController::columnCommands(x, cmds);  // Column.
+    for (i = 0; i < n; i++)
+      writeCommand(cmds[i]);
+  }
+  else
+    mElidedCommands++;
+
+  if (y != mAddrY)
+    writeCommand(nokiaController::bankCommand(y));  // Row.
+  else
+    mElidedCommands++;
+}
+
+/*
+ * Name         : elidedCommands
+ * Description  : How many address commands were not needed since the last call
+ * Argument(s)  : none
+ * Return value : count of skipped commands
+ */
+unsigned int nokiaDisplay::elidedCommands()
+{
+  unsigned int count = mElidedCommands;
+  mElidedCommands = 0;
+  return count;
+}
+
+void nokiaDisplay::backlight(byte level)
 {
+  writeLed(level);
+}
+
+void nokiaDisplay::beginPins()
+{
+  pinMode(mPin_reset, OUTPUT);
+  if (mPin_led != LCD_NO_PIN) {
+      pinMode(mPin_led, OUTPUT);
+  }
+}
+
+void nokiaDisplay::writeReset(byte level)
+{
+  digitalWrite(mPin_reset, level);
+}
+
+void nokiaDisplay::writeLed(byte level)
+{
+  if (mPin_led == LCD_NO_PIN)
+    return;
+
   if (level == 0)
     digitalWrite(mPin_led, LOW);
   else if (level == 1)
@@ -172,30 +290,177 @@ void nokiaLCD::backlight(byte level)
 // *************************** character writing funcs ***********************************************
 
 
-void nokiaLCD::setFont(byte* font, byte width)
+/*
+ * Name         : setFont
+ * Description  : Draw text with a fixed width font - width columns per char,
+ *                from char 32 on. Chars past lastChar are drawn as a space.
+ * Argument(s)  : font - in progmem, e.g. smallFont from font_5x7.h
+ *                width - columns per char, not counting the blank column after it
+ *                lastChar - the last char in the font
+ * Return value : none
+ */
+void nokiaDisplay::setFont(byte* font, byte width, byte lastChar)
 {
   mFont = font;
   mFontWidth = width;
+  mFontLast = lastChar;
+  mPropFont = 0;
+  mFontBanks = 1;
+}
+
+/*
+ * Name         : setPropFont
+ * Description  : Draw text with a proportional font - each char is only as wide
+ *                as its glyph, plus 1 blank column. A font taller than 8 pixels
+ *                takes a bank for every 8, and line feeds move down that many.
+ *                setCursor() still counts columns of the fixed font. The text
+ *                scale comes down if the font would no longer fit the screen.
+ * Argument(s)  : font - in progmem, see font_prop.h for the layout
+ * Return value : none
+ */
+void nokiaDisplay::setPropFont(const unsigned char* font)
+{
+  mPropFont = font;
+  mFontBanks = (pgm_read_byte(font) + 7) / 8;
+  setTextScale(mTextScale);
+}
+
+/*
+ * Name         : glyph
+ * Description  : Find the columns of a char in the current font. Chars outside the
+ *                font are drawn as a space, or as the proportional font's default char -
+ *                as are the chars of a proportional font with a width of 0.
+ *                The width of a proportional glyph is summed from the last glyph
+ *                in the sparse offset table - at most 31 back.
+ * Argument(s)  : ch - character
+ *                width - set to the number of columns
+ * Return value : progmem pointer to the first column
+ */
+const unsigned char* nokiaDisplay::glyph(byte ch, byte& width)
+{
+  const unsigned char* font = mPropFont;
+  byte first, last, bits, banks, count, g, i;
+  unsigned int offset, pos, w;
+  const unsigned char* widths;
+
+  if (!font) {
+    width = mFontWidth;
+    if (ch < 32 || ch > mFontLast) ch = ' ';
+    return mFont + (ch - 32) * mFontWidth;
+  }
+
+  first = pgm_read_byte(font + 1);
+  last = pgm_read_byte(font + 2);
+  bits = pgm_read_byte(font + 4);
+  banks = (pgm_read_byte(font) + 7) / 8;
+  if (ch < first || ch > last)
+    ch = pgm_read_byte(font + 3);
+  count = last - first + 1;
+  g = ch - first;
+
+  // the offset table has an entry for every 32nd glyph after the first
+  font += 5;
+  widths = font + (count - 1) / 32 * 2;
+  offset = 0;
+  if (g >= 32)
+    offset = pgm_read_byte(font + (g / 32 - 1) * 2) | (pgm_read_byte(font + (g / 32 - 1) * 2 + 1) << 8);
+
+  // add up the widths from there - each is bits wide, packed low bit first
+  for (i = g & ~31; ; i++) {
+    pos = (unsigned int)i * bits;
+    w = pgm_read_byte(widths + pos / 8) | (pgm_read_byte(widths + pos / 8 + 1) << 8);
+    width = (w >> (pos % 8)) & ((1 << bits) - 1);
+    if (i == g) break;
+    offset += width * banks;
+  }
+
+  if (!width && ch != pgm_read_byte(mPropFont + 3))
+    return glyph(pgm_read_byte(mPropFont + 3), width); // no glyph for ch
+  return widths + ((unsigned int)count * bits + 7) / 8 + offset;
 }
 
-void nokiaLCD::setTextMode(bool highlight)
+/*
+ * Name         : setTextScale
+ * Description  : Draw text n times the size of the font - a 5x7 font at 2 takes
+ *                12 columns and 2 banks per char. Line feeds move down n banks.
+ *                Only as far as the font still fits the screen - a 24 pixel
+ *                font stops at 2 on a 6 bank display.
+ * Argument(s)  : scale - 1 (normal) to 4
+ * Return value : none
+ */
+void nokiaDisplay::setTextScale(byte scale)
+{
+  if (scale < 1) scale = 1;
+  if (scale > 4) scale = 4;
+  while (scale > 1 && mFontBanks * scale > LCDROWMAX)
+    scale--;
+  mTextScale = scale;
+}
+
+void nokiaDisplay::setTextMode(bool highlight)
 {
   mNormalMode = !highlight;
 }
 
-void nokiaLCD::setTextWrap(boolean wrapOn)
+void nokiaDisplay::setTextWrap(boolean wrapOn)
 {
   mWrapText = wrapOn;
 }
 
-void nokiaLCD::writeCR()
+nokiaTextStyle nokiaDisplay::getTextStyle()
+{
+  nokiaTextStyle style;
+  style.font = mFont;
+  style.fontWidth = mFontWidth;
+  style.fontLast = mFontLast;
+  style.propFont = mPropFont;
+  style.scale = mTextScale;
+  style.normalMode = mNormalMode;
+  style.wrap = mWrapText;
+  return style;
+}
+
+/*
+ * Name         : setTextStyle
+ * Description  : Put back text settings saved by getTextStyle() - the fixed
+ *                font stays behind a proportional one, so both come back
+ * Argument(s)  : style - from getTextStyle()
+ * Return value : none
+ */
+void nokiaDisplay::setTextStyle(const nokiaTextStyle& style)
+{
+  setFont(style.font, style.fontWidth, style.fontLast);
+  if (style.propFont)
+    setPropFont(style.propFont);
+  setTextScale(style.scale);
+  mNormalMode = style.normalMode;
+  mWrapText = style.wrap;
+}
+
+void nokiaDisplay::resetTextStyle()
+{
+  setFont(smallFont, 5);
+  mTextScale = 1;
+  mNormalMode = true;
+  mWrapText = true;
+}
+
+void nokiaDisplay::writeCR()
 {
   gotoCol(0);
 }
 
-void nokiaLCD::writeLF()
+void nokiaDisplay::writeLF()
 {
-  gotoLine(mCursorRow+1);
+  byte lines = mFontBanks * mTextScale;
+  byte row = mCursorRow + lines;
+#if defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
+  if (mTerminal && lines <= LCDROWMAX && row + lines > LCDROWMAX) {
+    scroll(0, -8 * (row + lines - LCDROWMAX));
+    row = LCDROWMAX - lines;
+  }
+#endif
+  gotoLine(row);
 }
 
 /*
@@ -207,9 +472,11 @@ void nokiaLCD::writeLF()
  * Return value : none
  */
 
-void nokiaLCD::writeChar(byte ch)
+void nokiaDisplay::writeChar(byte ch)
 {
-	byte j;
+	nokiaTransaction transaction(*this);
+	byte j, width;
+	const unsigned char* columns;
 
   if (ch == '\r')
   {
@@ -223,12 +490,18 @@ void nokiaLCD::writeChar(byte ch)
     return;
   }
 
+  columns = glyph(ch, width);
+  if (mTextScale > 1 || mFontBanks > 1) {
+    writeCharBanks(columns, width);
+    return;
+  }
+
 // the graphic mode allows graphics to draw over the text without wipping it out. There does seem to be a bug in
 // crossing reversed chars though - they do get wipped out.
 #ifdef USE_GRAPHIC
   // ensure space is available for the character
       // orig:   mCursorCol = LCDCOLMAX - mFontWidth;
-  if (mCursorCol > LCDCOLMAX - mFontWidth) {
+  if (mCursorCol > LCDCOLMAX - width) {
     if (mWrapText)
     {
       writeCR();
@@ -246,19 +519,21 @@ void nokiaLCD::writeChar(byte ch)
       return; // overflow on bottom- just exit
   }
 
-	mBuffer[mCursorRow][mCursorCol] = 0x00;
-	for(j=0; j<mFontWidth; j++)
-  {
-		mBuffer[mCursorRow][mCursorCol + j] =  pgm_read_byte(&(mFont [(ch-32)*mFontWidth + j] ));
-   }
-	mBuffer[mCursorRow][mCursorCol + mFontWidth] = 0x00; // blank 1 px space after char
-
-	for(j=0; j< mFontWidth+1; j++) // extra pixel for space after char
+	for(j=0; j< width+1; j++) // extra pixel for space after char
   {
-		if (mNormalMode)
-			writeData(mBuffer[mCursorRow][mCursorCol++]);
+		byte data = (j < width) ? pgm_read_byte(columns + j) : 0x00;
+		if (!mNormalMode)
+			data ^= 0xff;
+		// the buffer holds exactly what is sent, so reversed chars survive an update()
+		byte* buf = (mCursorRow < LCDROWMAX && mCursorCol < LCDCOLMAX) ? bufferRow(mCursorRow) : 0;
+		if (buf)
+			buf[mCursorCol] = data;
+		if (isDeferred()) {
+			if (buf) markDirty(mCursorRow, mCursorCol, mCursorCol);
+		}
 		else
-			writeData(mBuffer[mCursorRow][mCursorCol++] ^ 0xff);
+			writeData(buf ? screenByte(mCursorRow, mCursorCol) : data); // with any sprites over it
+		mCursorCol++;
 		if ((mCursorCol >= LCDCOLMAX) && mWrapText)
 		{
       writeCR();
@@ -266,16 +541,98 @@ void nokiaLCD::writeChar(byte ch)
 		}
 	}
 #else
-	for(j=0; j<mFontWidth; j++) {
+	for(j=0; j<width; j++) {
 		if (mNormalMode)
-			writeData( pgm_read_byte(&(mFont [(ch-32)*mFontWidth + j] )) );
+			writeData( pgm_read_byte(columns + j) );
 		else
-			writeData( pgm_read_byte(&(mFont [(ch-32)*mFontWidth + j] )) ^ 0xff );
+			writeData( pgm_read_byte(columns + j) ^ 0xff );
 	}
 	writeData( (mNormalMode) ? 0x00 : 0xff );
 #endif
 }
 
+/*
+ * Name         : writeCharBanks
+ * Description  : writeChar() for a font taller than a bank, or scaled up by
+ *                setTextScale(). Sent a bank at a time with one address per bank.
+ *                When scaled, each bank of the font is spread over mTextScale
+ *                banks a nibble at a time through sSpreadNibble, and each
+ *                column repeated mTextScale times across.
+ * Argument(s)  : columns - the glyph in progmem, a bank at a time
+ *                width - its number of columns
+ * Return value : none
+ */
+void nokiaDisplay::writeCharBanks(const unsigned char* columns, byte width)
+{
+  nokiaTransaction transaction(*this);
+  byte scale = mTextScale;
+  byte lines = mFontBanks * scale; // banks the char takes
+  const uint16_t* spread = sSpreadNibble[(scale > 1) ? scale - 2 : 0];
+  const unsigned char* bank;
+  byte b, j, k, x, row, data;
+  unsigned long bits;
+
+  if (lines > LCDROWMAX || width * scale > LCDCOLMAX)
+    return; // bigger than the screen even from the corner
+
+  if (mCursorCol > LCDCOLMAX - width * scale) {
+    if (!mWrapText) return;
+    writeCR();
+    writeLF();
+  }
+  if (mCursorRow > LCDROWMAX - lines) {
+    if (!mWrapText) return; // overflow on bottom- just exit
+    home();
+  }
+
+  x = mCursorCol;
+  for (b = 0; b < lines; b++) {
+    row = mCursorRow + b;
+    if (row >= LCDROWMAX) break; // taller than the screen
+#ifdef USE_GRAPHIC
+    byte* buf = bufferRow(row);
+#endif
+    if (!isDeferred())
+      setAddress(mCursorCol, row);
+
+    bank = columns + (b / scale) * width;
+    x = mCursorCol;
+    for (j = 0; j <= width; j++) { // extra column for space after char
+      data = (j < width) ? pgm_read_byte(bank + j) : 0x00;
+      if (scale > 1) {
+        bits = pgm_read_word(spread + (data & 0x0f)) | ((unsigned long)pgm_read_word(spread + (data >> 4)) << (4 * scale));
+        data = bits >> (8 * (b % scale));
+      }
+      if (!mNormalMode)
+        data ^= 0xff;
+
+      for (k = 0; k < scale && x < LCDCOLMAX; k++, x++) {
+#ifdef USE_GRAPHIC
+        if (buf)
+          buf[x] = data;
+        if (!isDeferred())
+          writeData(buf ? screenByte(row, x) : data);
+#else
+        writeData(data);
+#endif
+      }
+    }
+#ifdef USE_GRAPHIC
+    if (isDeferred() && x > mCursorCol)
+      markDirty(row, mCursorCol, x - 1);
+#endif
+  }
+
+  // the address is at the end of the last bank - put it back on the text line
+  if (x >= LCDCOLMAX && mWrapText)
+  {
+    writeCR();
+    writeLF();
+  }
+  else
+    gotoXY(x, mCursorRow);
+}
+
 /*
  * Name         : write
  * Description  : write a character - override function in Print class
@@ -283,12 +640,110 @@ void nokiaLCD::writeChar(byte ch)
  * Return value : none
  */
 #if defined(ARDUINO) && ARDUINO >= 100
-size_t nokiaLCD::write(byte character)
+size_t nokiaDisplay::write(byte character)
 #else
-void nokiaLCD::write(byte character)
+void nokiaDisplay::write(byte character)
 #endif
 {
   writeChar(character);
+#if defined(ARDUINO) && ARDUINO >= 100
+  return 1;
+#endif
+}
+
+
+/*
+ * Name         : writeLine
+ * Description  : write() of the chars that fit on the current line, in one pass -
+ *                their columns are streamed one after another from the address
+ *                the cursor is at, and a deferred run is marked dirty once.
+ *                Stops at a carriage return or line feed, at the first char
+ *                writeChar() would have to wrap, and before scaled or tall text.
+ * Argument(s)  : chars - characters to write, size - how many
+ * Return value : how many were written - 0 leaves the first to writeChar()
+ */
+size_t nokiaDisplay::writeLine(const uint8_t* chars, size_t size)
+{
+  size_t n;
+  byte j, width, data;
+  const unsigned char* columns;
+
+  if (mTextScale > 1 || mFontBanks > 1)
+    return 0;
+#ifdef USE_GRAPHIC
+  if (mCursorRow >= LCDROWMAX)
+    return 0;
+  byte row = mCursorRow, first = mCursorCol;
+  byte* buf = bufferRow(row);
+#endif
+
+  for (n = 0; n < size && chars[n] != '\r' && chars[n] != '\n'; n++) {
+    columns = glyph(chars[n], width);
+#ifdef USE_GRAPHIC
+    if (mCursorCol + width + 1 >= LCDCOLMAX)
+      break; // the blank column wraps - writeChar() does that
+#endif
+    for (j = 0; j <= width; j++) { // extra column for space after char
+      data = (j < width) ? pgm_read_byte(columns + j) : 0x00;
+      if (!mNormalMode)
+        data ^= 0xff;
+#ifdef USE_GRAPHIC
+      if (buf)
+        buf[mCursorCol] = data;
+      if (!isDeferred())
+        writeData(buf ? screenByte(row, mCursorCol) : data);
+      mCursorCol++;
+#else
+      writeData(data);
+#endif
+    }
+  }
+#ifdef USE_GRAPHIC
+  if (isDeferred() && buf && mCursorCol > first)
+    markDirty(row, first, mCursorCol - 1);
+#endif
+  return n;
+}
+
+/*
+ * Name         : write
+ * Description  : write a run of characters - override function in Print class,
+ *                so print() of a string or a number is sent as one burst, laid
+ *                out a line at a time by writeLine()
+ * Argument(s)  : buffer - characters to write, size - how many
+ * Return value : number of characters written
+ */
+#if defined(ARDUINO) && ARDUINO >= 100
+size_t nokiaDisplay::write(const uint8_t *buffer, size_t size)
+#else
+void nokiaDisplay::write(const uint8_t *buffer, size_t size)
+#endif
+{
+  nokiaTransaction transaction(*this);
+  size_t i = 0, n;
+
+  while (i < size) {
+    n = writeLine(buffer + i, size - i);
+    if (n)
+      i += n;
+    else
+      writeChar(buffer[i++]); // line feeds, wraps and big text
+  }
+#if defined(ARDUINO) && ARDUINO >= 100
+  return size;
+#endif
+}
+
+/*
+ * Name         : writeString
+ * Description  : Write a string at the current cursor position, in one
+ *                transaction - see beginTransaction()
+ * Argument(s)  : string - string pointer of data to display
+ * Return value : none
+ */
+void nokiaDisplay::writeString(const char *string)
+{
+  write((const uint8_t*)string, strlen(string));
 }
 
 
@@ -301,8 +756,9 @@ void nokiaLCD::write(byte character)
  *                mode - reverse or normal
  * Return value : none
  */
-void nokiaLCD::writeStringBig( byte x,byte y, char *string)
+void nokiaDisplay::writeStringBig( byte x,byte y, char *string)
 {
+    nokiaTransaction transaction(*this);
     while ( *string ){
         writeCharBig( x, y, *string);
 
@@ -319,13 +775,16 @@ void nokiaLCD::writeStringBig( byte x,byte y, char *string)
  * Name         : writeCharBig
  * Description  : Write a single big character to screen
  * 		  Note: bigfont only includes digits, '.', '+', '-'
+ * 		  For any other font height or char range, use setPropFont()
+ * 		  with a tall font - see font_prop_big.h
  * Argument(s)  : x,y - starting position on screen, x=0-83, y=0-6
  *                ch - character to display
  *                mode - reverse or normal
  * Return value : none
  */
-void nokiaLCD::writeCharBig (byte x,byte y, byte ch)
+void nokiaDisplay::writeCharBig (byte x,byte y, byte ch)
 {
+  nokiaTransaction transaction(*this);
   byte i, j;
   byte *pFont = &big_number_font[0];
   byte ch_dat;
@@ -350,15 +809,28 @@ void nokiaLCD::writeCharBig (byte x,byte y, byte ch)
 
    for(i=0;i<3;i++) {
      gotoXY( x, y+i);
+#ifdef USE_GRAPHIC
+     byte* buf = bufferRow(mCursorRow);
+#endif
 
      for(j=0; j<colsUsed; j++) {
        ch_dat =  pgm_read_byte(pFont+ch*48 + i*16 +j);	// 16 cols in data for char even if we use fewer.
        //ch_dat =  pgm_read_byte(pFont+ch*48 + i*12 +j);	// 12 cols in data for char even if we use fewer.
+       if (!mNormalMode)
+         ch_dat ^= 0xff;
 #ifdef USE_GRAPHIC
-       mBuffer[mCursorRow][mCursorCol + j] = (mNormalMode)? ch_dat : (ch_dat^0xff);
+       if (buf) {
+         buf[mCursorCol + j] = ch_dat;
+         ch_dat = screenByte(mCursorRow, mCursorCol + j); // with any sprites over it
+       }
+       if (isDeferred()) continue;
 #endif
-       writeData( (mNormalMode)? ch_dat : (ch_dat^0xff));
+       writeData(ch_dat);
      }
+#ifdef USE_GRAPHIC
+     if (isDeferred())
+       markDirty(mCursorRow, mCursorCol, mCursorCol + colsUsed - 1);
+#endif
    }
 }
 
@@ -379,8 +851,9 @@ void nokiaLCD::writeCharBig (byte x,byte y, byte ch)
  *                size_y is multiple of 8
  * Return value : none
  */
-void nokiaLCD::drawBitmap(byte x,byte y, byte *map, byte size_x,byte size_y)
+void nokiaDisplay::drawBitmap(byte x,byte y, byte *map, byte size_x,byte size_y)
 {
+    nokiaTransaction transaction(*this);
     unsigned int i,n;
     byte row;
 
@@ -394,8 +867,20 @@ void nokiaLCD::drawBitmap(byte x,byte y, byte *map, byte size_x,byte size_y)
     for (n=0;n<row;n++) {
       	gotoXY(x,y);
         for(i=0; i<size_x; i++) {
-            writeData(map[i+n*size_x]);
+            byte data = map[i+n*size_x];
+#ifdef USE_GRAPHIC
+            if (y < LCDROWMAX && x+i < LCDCOLMAX && bufferRow(y)) {
+              bufferRow(y)[x+i] = data;
+              data = screenByte(y, x+i); // with any sprites over it
+            }
+#endif
+            if (!isDeferred())
+              writeData(data);
           }
+#ifdef USE_GRAPHIC
+        if (isDeferred() && y < LCDROWMAX && x < LCDCOLMAX)
+          markDirty(y, x, (x + size_x > LCDCOLMAX) ? LCDCOLMAX - 1 : x + size_x - 1);
+#endif
         y++;
       }
 }
@@ -417,8 +902,9 @@ void nokiaLCD::drawBitmap(byte x,byte y, byte *map, byte size_x,byte size_y)
  *                size_y is multiple of 8
  * Return value : none
  */
-void nokiaLCD::drawBitmapP(byte x,byte y, const prog_char *map, byte size_x, byte size_y)
+void nokiaDisplay::drawBitmapP(byte x,byte y, const prog_char *map, byte size_x, byte size_y)
 {
+    nokiaTransaction transaction(*this);
     unsigned int i,n;
     byte row;
     const prog_char *dptr;
@@ -433,13 +919,92 @@ void nokiaLCD::drawBitmapP(byte x,byte y, const prog_char *map, byte size_x, byt
       	gotoXY(x,y);
         for(i=0; i<size_x; i++) {
             dptr = map + (i + n * size_x);
-            writeData( pgm_read_byte( dptr ) );
+            byte data = pgm_read_byte( dptr );
+#ifdef USE_GRAPHIC
+            if (y < LCDROWMAX && x+i < LCDCOLMAX && bufferRow(y)) {
+              bufferRow(y)[x+i] = data;
+              data = screenByte(y, x+i); // with any sprites over it
+            }
+#endif
+            if (!isDeferred())
+              writeData(data);
           }
+#ifdef USE_GRAPHIC
+        if (isDeferred() && y < LCDROWMAX && x < LCDCOLMAX)
+          markDirty(y, x, (x + size_x > LCDCOLMAX) ? LCDCOLMAX - 1 : x + size_x - 1);
+#endif
         y++;
     }
 }
 
 
+/*
+ * Name         : drawBitmapRLE_P
+ * Description  : drawBitmapP() for an image stored PackBits encoded in progmem,
+ *                decoded on the fly. The bytes are in the same order as for
+ *                drawBitmapP(), and packed as a series of runs:
+ *                  0-127   - copy the next n+1 bytes
+ *                  129-255 - repeat the next byte 257-n times
+ *                  128     - ignored
+ *                Runs may carry on into the next bank. Use extras/host/bitmapRLE
+ *                to convert a pbm image.
+ *                With USE_GRAPHIC only the columns that differ from the screen
+ *                buffer are sent, so a mostly blank image over a blank area costs little.
+ * Argument(s)  : x, y - Position on screen, x 0-83, y 1-6
+ *                map - pointer to the encoded data
+ *                size_x,size_y - Size of the image in pixels,
+ *                size_y is multiple of 8
+ * Return value : none
+ */
+void nokiaDisplay::drawBitmapRLE_P(byte x,byte y, const prog_char *map, byte size_x, byte size_y)
+{
+    nokiaTransaction transaction(*this);
+    byte i,n,row;
+    byte count = 0; // bytes left in the current run
+    byte data = 0;
+    byte ctl;
+    bool repeat = false;
+
+    row = (size_y % 8 == 0 ) ? size_y / 8 : size_y / 8 + 1;
+
+    for (n=0;n<row;n++) {
+#ifdef USE_GRAPHIC
+        byte* buf = (y < LCDROWMAX) ? bufferRow(y) : 0;
+        byte first = LCDCOLMAX, last = 0;
+#else
+        gotoXY(x,y);
+#endif
+        for(i=0; i<size_x; i++) {
+            if (count == 0) {
+                do {
+                    ctl = pgm_read_byte(map++);
+                } while (ctl == 128);
+                repeat = (ctl > 128);
+                count = repeat ? 257 - ctl : ctl + 1;
+                if (repeat)
+                    data = pgm_read_byte(map++);
+            }
+            if (!repeat)
+                data = pgm_read_byte(map++);
+            count--;
+#ifdef USE_GRAPHIC
+            if (buf && x+i < LCDCOLMAX && buf[x+i] != data) {
+                buf[x+i] = data;
+                if (x+i < first) first = x+i;
+                last = x+i;
+            }
+#else
+            writeData(data);
+#endif
+        }
+#ifdef USE_GRAPHIC
+        if (first <= last)
+            spanChanged(y, first, last);
+#endif
+        y++;
+    }
+}
+
 /*
  * Name         : clearBitmap
  * Description  : Clear an area of the screen, usually to blank out a
@@ -449,9 +1014,8 @@ void nokiaLCD::drawBitmapP(byte x,byte y, const prog_char *map, byte size_x, byt
  *                size_y is multiple of 8
  * Return value : none
  */
-void nokiaLCD::clearBitmap( byte x,byte y, byte size_x,byte size_y)
+void nokiaDisplay::clearBitmap( byte x,byte y, byte size_x,byte size_y)
 {
-    unsigned int i,n;
     byte row;
 
     row = (size_y % 8 == 0 ) ? size_y / 8 : size_y / 8 + 1;
@@ -460,6 +1024,16 @@ void nokiaLCD::clearBitmap( byte x,byte y, byte size_x,byte size_y)
 //    else
 //    	    row=size_y/8+1;
 
+#ifdef USE_GRAPHIC
+    if (size_x == 0 || row == 0 || x >= LCDCOLMAX || y >= LCDROWMAX)
+      return;
+    fillArea(x, y * 8,
+             (x + size_x > LCDCOLMAX) ? LCDCOLMAX - 1 : x + size_x - 1,
+             (y + row > LCDROWMAX) ? LCDPIXELROWMAX - 1 : (y + row) * 8 - 1,
+             PIXEL_OFF);
+#else
+    unsigned int i,n;
+
     for (n=0;n<row;n++) {
       	gotoXY(x,y);
         for(i=0; i<size_x; i++) {
@@ -467,6 +1041,7 @@ void nokiaLCD::clearBitmap( byte x,byte y, byte size_x,byte size_y)
         }
         y++;
     }
+#endif
 }
 #endif
 
@@ -475,69 +1050,467 @@ void nokiaLCD::clearBitmap( byte x,byte y, byte size_x,byte size_y)
 
 /*
  * Name         : update
- * Description  : Write the screen buffer to the display memory
+ * Description  : Write the changed parts of the screen buffer to the display memory.
+ *                Only the dirty column span of each bank is sent, with one gotoXY per span.
  * Argument(s)  : none
  * Return value : none
  */
-void nokiaLCD::update() {
-#ifdef USE_GRAPHIC
-	int i,j;
+void nokiaDisplay::update() {
+	nokiaTransaction transaction(*this);
+#if defined(USE_STATS) && !defined(USE_PAGED_BUFFER)
+	countUpdate();
+#endif
+#if defined(USE_ASYNC_UPDATE)
+	byte i;
+
+	waitFlush(); // only one update in flight - the back buffer is in use until then
+#ifdef USE_STATS
+	mFlushStart = micros();
+#endif
 
 	for(i=0; i< LCDROWMAX; i++) {
-		gotoXY (0,i);
-		for(j=0; j< LCDCOLMAX; j++) {
-			writeData(mBuffer[i][j]);
-		}
+		mFlushMin[i] = mDirtyMin[i];
+		mFlushMax[i] = mDirtyMax[i];
+		if (mDirtyMin[i] > mDirtyMax[i]) continue; // bank is clean
+#ifdef USE_SPRITES
+		for (byte j = mDirtyMin[i]; j <= mDirtyMax[i]; j++)
+			mBackBuffer[i][j] = screenByte(i, j);
+#else
+		memcpy(&mBackBuffer[i][mDirtyMin[i]], &mBuffer[i][mDirtyMin[i]], mDirtyMax[i] - mDirtyMin[i] + 1);
+#endif
+		markClean(i);
 	}
+
+	// the background update ends with the XY position back at (0,0)
+	mCursorRow = 0;
+	mCursorCol = 0;
+
+	mFlushBusy = true; // no flushStep() until the bus is selected for it
+	mFlushRow = 0;
+	mFlushPhase = 0;
+	mFlushing = true;
+	if (mSelected)
+		mTransport->deselect(); // the background update has the bus until it is done
+	mSelected = false;
+	mDC = LCD_ADDR_UNKNOWN; // and leaves D/C as it likes
+	mTransport->select();
+	foregroundFlushByte();
+#elif defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
+#ifdef USE_STATS
+	unsigned long start = micros();
+#endif
+
+	sendDirty();
+	gotoXY (0,0);	//bring the XY position back to (0,0)
+#ifdef USE_STATS
+	recordFlush(micros() - start);
 #endif
+#else
 	gotoXY (0,0);	//bring the XY position back to (0,0)
+#endif
 }
 
-
-#ifdef USE_GRAPHIC
+#if defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
 /*
- * Name         : setPixel
- * Description  : Set a single pixel either on or off, update display buffer.
- * Argument(s)  : x,y - position, x = 0-83, y = 0-47
- *                c - colour, either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
+ * Name         : sendDirty
+ * Description  : Send the dirty span of each bank and mark it clean, in the
+ *                foreground. Leaves the address wherever the last span ended.
+ * Argument(s)  : none
  * Return value : none
  */
-void nokiaLCD::setPixel( byte x, byte y, byte c )
+void nokiaDisplay::sendDirty()
 {
-  byte value;
-  byte row;
-
-	if( x < 0 || x >= LCDCOLMAX || y < 0 || y >= LCDPIXELROWMAX ) return;
-
-	row = y / 8;
+	nokiaTransaction transaction(*this);
+	byte i,j;
 
-	value = mBuffer[row][x];
-	if( c == PIXEL_ON ) {
-		value |= (1 << (y % 8));
-	} else if( c == PIXEL_XOR ) {
-		value ^= (1 << (y % 8));
-	} else {
-		value &= ~(1 << (y % 8));
+	for(i=0; i< LCDROWMAX; i++) {
+		if (mDirtyMin[i] > mDirtyMax[i]) continue; // bank is clean
+		setAddress (mDirtyMin[i],i);
+		for(j=mDirtyMin[i]; j<= mDirtyMax[i]; j++) {
+			writeData(screenByte(i, j));
+		}
+		markClean(i);
 	}
+}
 
-	mBuffer[row][x] = value;
+/*
+ * Name         : updateStep
+ * Description  : update() a slice at a time, for a loop() that must not block.
+ *                Sends dirty spans for up to budget us and returns; the next call
+ *                carries on from the first unsent column, since that is where the
+ *                span now starts. The screen is gone through once per update, so
+ *                what is drawn behind the columns already sent waits for the next.
+ *                With USE_ASYNC_UPDATE the update runs in the background instead
+ *                and this only starts it. See nokiaScheduler.
+ * Argument(s)  : budget - time allowed in us; at least one byte is always sent
+ * Return value : true when the update is done
+ */
+bool nokiaDisplay::updateStep(unsigned int budget)
+{
+#ifdef USE_ASYNC_UPDATE
+	if (!mFlushing) {
+		if (mStepRow) { // the background update has finished meanwhile
+			mStepRow = 0;
+			return true;
+		}
+		byte i;
+		for (i = 0; i < LCDROWMAX && mDirtyMin[i] > mDirtyMax[i]; i++)
+			;
+		if (i == LCDROWMAX)
+			return true; // nothing to send
+		mStepRow = 1;
+		update();
+	}
+
+	if (!mTransport->canInterrupt()) { // no isr to send it - use the budget
+		unsigned long start = micros();
+		do
+			foregroundFlushByte();
+		while (mFlushing && micros() - start < budget);
+	}
+	if (mFlushing)
+		return false;
+	mStepRow = 0;
+	return true;
+#else
+	nokiaTransaction transaction(*this);
+	unsigned long start = micros();
+	bool sent = false;
+
+	for (; mStepRow < LCDROWMAX; mStepRow++, mStepCol = 0) {
+		byte i = mStepRow;
+		byte x;
+		while ((x = (mDirtyMin[i] > mStepCol) ? mDirtyMin[i] : mStepCol) <= mDirtyMax[i]) {
+			if (sent && micros() - start >= budget)
+				return false;
+			setAddress(x, i); // no command while the span is sent in order
+			writeData(screenByte(i, x));
+			if (mDirtyMin[i] == x)
+				mDirtyMin[i]++;
+			mStepCol = x + 1;
+			sent = true;
+		}
+		// anything drawn behind mStepCol meanwhile is left for the next update
+		if (mDirtyMin[i] < mStepCol)
+			mDirtyMax[i] = mStepCol - 1;
+		else
+			markClean(i);
+	}
+	mStepRow = 0;
+	return true;
+#endif
+}
+#endif
+
+#ifdef USE_ASYNC_UPDATE
+/*
+ * Name         : nextFlushByte
+ * Description  : Send the next byte of a background update. Runs from the transport's
+ *                isr, so the state is always advanced before the byte is started.
+ *                Per dirty bank: column cmd(s), row cmd, then the data; at the end the
+ *                address goes back to (0,0) like a blocking update(). Address cmds
+ *                the controller is already at are skipped, as in setAddress().
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::nextFlushByte()
+{
+  byte row = mFlushRow;
+  byte data;
+
+  for (;;) {
+    switch (mFlushPhase) {
+    case 0: // address of the next dirty bank - only the parts that change
+      while (row < LCDROWMAX && mFlushMin[row] > mFlushMax[row])
+        row++;
+      mFlushRow = row;
+      mFlushCol = (row < LCDROWMAX) ? mFlushMin[row] : 0;
+      data = (row < LCDROWMAX) ? row : 0;
+
+      mFlushCmdCount = 0;
+      mFlushCmdIndex = 0;
+      if (mAddrX != mFlushCol) {
+        mFlushCmdCount = nokiaController::columnCommands(mFlushCol, mFlushCmd);
+        mAddrX = mFlushCol;
+      }
+      else
+        mElidedCommands++;
+      if (mAddrY != data) {
+        mFlushCmd[mFlushCmdCount++] = nokiaController::bankCommand(data);
+        mAddrY = data;
+      }
+      else
+        mElidedCommands++;
+
+      mTransport->setDC(LCD_CMD);
+      mFlushPhase = 1;
+      continue;
+
+    case 1: // address cmds
+      if (mFlushCmdIndex < mFlushCmdCount) {
+#ifdef USE_STATS
+        mStats.commandBytes++;
+#endif
+        mTransport->startTransfer(mFlushCmd[mFlushCmdIndex++]);
+        return;
+      }
+      mFlushPhase = (row < LCDROWMAX) ? 2 : 3;
+      continue;
+
+    case 2: // data
+      data = mBackBuffer[row][mFlushCol];
+      if (mFlushCol == mFlushMin[row])
+        mTransport->setDC(LCD_DATA);
+      if (mFlushCol++ == mFlushMax[row]) {
+        mFlushRow++;
+        mFlushPhase = 0;
+      }
+      advanceAddress();
+#ifdef USE_STATS
+      mStats.dataBytes++;
+#endif
+      mTransport->startTransfer(data);
+      return;
+
+    default: // all sent
+      mTransport->deselect();
+#ifdef USE_STATS
+      recordFlush(micros() - mFlushStart);
+#endif
+      mFlushing = false;
+      if (mFlushCallback)
+        mFlushCallback();
+      return;
+    }
+  }
+}
+
+void nokiaDisplay::flushComplete(void* lcd)
+{
+  ((nokiaDisplay*)lcd)->nextFlushByte();
+}
+
+/*
+ * Name         : foregroundFlushByte
+ * Description  : nextFlushByte() from the foreground. It is not re-entrant, and
+ *                without a transport interrupt flushStep() may be called from a
+ *                timer isr at any time - so it leaves the update alone meanwhile.
+ *                The isr may have sent the last byte since the caller saw the
+ *                update going, so that is looked at again once it is shut out.
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::foregroundFlushByte()
+{
+  mFlushBusy = true;
+  if (mFlushing)
+    nextFlushByte();
+  mFlushBusy = false;
+}
+
+void nokiaDisplay::flushStep()
+{
+  if (mFlushing && !mFlushBusy && !mTransport->canInterrupt())
+    nextFlushByte();
+}
+
+void nokiaDisplay::waitFlush()
+{
+  while (mFlushing) {
+    if (mTransport->canInterrupt())
+      mTransport->poll();
+    else
+      foregroundFlushByte();
+  }
+}
+
+void nokiaDisplay::setFlushCallback(void (*callback)())
+{
+  mFlushCallback = callback;
+}
+#endif
+
+
+/*
+ * Name         : invalidate
+ * Description  : Mark the whole screen buffer as changed, so the next update()
+ *                resends all of it - use after writing to the display with writeData()
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::invalidate() {
+#ifdef USE_GRAPHIC
+	for(byte i=0; i< LCDROWMAX; i++)
+		markDirty(i, 0, LCDCOLMAX - 1);
+#endif
+}
+
+#ifdef USE_PAGED_BUFFER
+/*
+ * Name         : renderPages
+ * Description  : Draw the screen one bank at a time with a one bank buffer.
+ *                draw is called once per bank and everything it draws outside
+ *                that bank is dropped; the bank is then sent whole.
+ *                The text cursor is the same at the start of every call.
+ * Argument(s)  : draw - draws the whole screen, the same way on every call
+ * Return value : none
+ */
+void nokiaDisplay::renderPages(void (*draw)(nokiaDisplay& lcd))
+{
+	nokiaTransaction transaction(*this);
+	byte row = mCursorRow;
+	byte col = mCursorCol;
+	byte x;
+#ifdef USE_STATS
+	unsigned long start = micros();
+	mStats.fullUpdates++;
+#endif
+
+	for (mPage = 0; mPage < LCDROWMAX; mPage++) {
+		memset(mBuffer[0], 0, LCDCOLMAX);
+		mCursorRow = row;
+		mCursorCol = col;
+		draw(*this);
+
+		setAddress(0, mPage);
+		for (x = 0; x < LCDCOLMAX; x++)
+			writeData(mBuffer[0][x]);
+	}
+	mPage = LCD_ADDR_UNKNOWN; // drawing outside renderPages() goes nowhere
+#ifdef USE_STATS
+	recordFlush(micros() - start);
+#endif
+}
+#endif
+
+
+#ifdef USE_GRAPHIC
+/*
+ * Name         : markDirty
+ * Description  : Grow the dirty column span of a bank
+ * Argument(s)  : row - bank 0-5
+ *                x1, x2 - first and last changed column, x1 <= x2
+ * Return value : none
+ */
+void nokiaDisplay::markDirty(byte row, byte x1, byte x2)
+{
+#ifndef USE_PAGED_BUFFER // renderPages() always sends the whole bank
+	if (x1 < mDirtyMin[row]) mDirtyMin[row] = x1;
+	if (x2 > mDirtyMax[row]) mDirtyMax[row] = x2;
+#endif
+}
+
+void nokiaDisplay::markClean(byte row)
+{
+#ifndef USE_PAGED_BUFFER
+	mDirtyMin[row] = LCDCOLMAX;
+	mDirtyMax[row] = 0;
+#endif
+}
+
+/*
+ * Name         : spanChanged
+ * Description  : Columns of the screen buffer were changed - send them now,
+ *                or in deferred mode mark them for the next update()
+ * Argument(s)  : row - bank 0-5
+ *                x1, x2 - first and last changed column, x1 <= x2
+ * Return value : none
+ */
+void nokiaDisplay::spanChanged(byte row, byte x1, byte x2)
+{
+	nokiaTransaction transaction(*this);
+	if (isDeferred()) {
+		markDirty(row, x1, x2);
+		return;
+	}
+
+	gotoXY(x1, row);
+	for (byte x = x1; x <= x2; x++)
+		writeData(screenByte(row, x));
+	if (x1 == 0 && x2 == LCDCOLMAX - 1)
+		markClean(row);
+}
+
+/*
+ * Name         : setDrawMode
+ * Description  : Select whether drawing goes straight to the display or only
+ *                to the screen buffer until the next update()
+ * Argument(s)  : mode - DRAW_IMMEDIATE or DRAW_DEFERRED
+ * Return value : none
+ */
+void nokiaDisplay::setDrawMode(byte mode)
+{
+	mDrawMode = mode;
+	if (!isDeferred())
+		setAddress(mCursorCol, mCursorRow); // deferred gotoXYs only moved the cursor
+}
+#endif
+
+
+#ifdef USE_GRAPHIC
+/*
+ * Name         : setPixel
+ * Description  : Set a single pixel either on or off, update display buffer.
+ * Argument(s)  : x,y - position, x = 0-83, y = 0-47
+ *                c - colour, either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
+ * Return value : none
+ */
+void nokiaDisplay::setPixel( byte x, byte y, byte c )
+{
+  byte value;
+  byte row;
+
+	if( x < 0 || x >= LCDCOLMAX || y < 0 || y >= LCDPIXELROWMAX ) return;
+
+	row = y / 8;
+
+	byte* buf = bufferRow(row);
+	if (!buf) return; // another bank is being drawn
+
+	value = buf[x];
+	if( c == PIXEL_ON ) {
+		value |= (1 << (y % 8));
+	} else if( c == PIXEL_XOR ) {
+		value ^= (1 << (y % 8));
+	} else {
+		value &= ~(1 << (y % 8));
+	}
+
+	buf[x] = value;
+
+	if (isDeferred()) {
+		markDirty(row, x, x);
+		return;
+	}
 
 	gotoXY (x,row);
-	writeData(value);
+	writeData(screenByte(row, x));
 }
 
 
 /*
  * Name         : drawLine
  * Description  : Draws a line between two points on the display.
+ *                Horizontal and vertical lines are filled a byte at a time.
+ *                Other lines step with Bresenham, but the pixels are gathered
+ *                into whole buffer bytes, and the changed columns are sent one
+ *                span per bank rather than one pixel at a time.
  * Argument(s)  : x1, y1 - Absolute pixel coordinates for line origin.
  *                x2, y2 - Absolute pixel coordinates for line end.
  *                c - either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
  * Return value : none
  */
-void nokiaLCD::drawLine(byte x1, byte y1, byte x2, byte y2, byte c)
+void nokiaDisplay::drawLine(byte x1, byte y1, byte x2, byte y2, byte c)
 {
+    nokiaTransaction transaction(*this);
     int dx, dy, stepx, stepy, fraction;
+    byte row, mask, spanStart;
+
+    /* axis aligned - just a one pixel wide rectangle */
+    if ( x1 == x2 || y1 == y2 ) {
+        fillArea( x1, y1, x2, y2, c );
+        return;
+    }
 
     /* Calculate differential form */
     /* dy   y2 - y1 */
@@ -567,8 +1540,10 @@ void nokiaLCD::drawLine(byte x1, byte y1, byte x2, byte y2, byte c)
     dx <<= 1;
     dy <<= 1;
 
-    /* Draw initial position */
-    setPixel( x1, y1, c );
+    /* Initial position - the byte being built and the span of its bank */
+    row = y1 / 8;
+    mask = 1 << (y1 % 8);
+    spanStart = x1;
 
     /* Draw next positions until end */
     if ( dx > dy ) {
@@ -582,13 +1557,20 @@ void nokiaLCD::drawLine(byte x1, byte y1, byte x2, byte y2, byte c)
             x1 += stepx;
             fraction += dy;
 
-            /* Draw calculated point */
-            setPixel( x1, y1, c );
+            /* every step is a new column - the last byte is done */
+            applyMask( x1 - stepx, row, mask, c );
+            if ( y1 / 8 != row ) {
+                clipSpan( row, spanStart, x1 - stepx );
+                row = y1 / 8;
+                spanStart = x1;
+            }
+            mask = 1 << (y1 % 8);
         }
     } else {
         /* Take fraction */
         fraction = dx - ( dy >> 1);
         while ( y1 != y2 ) {
+            byte lastX = x1;
             if ( fraction >= 0 ) {
                 x1 += stepx;
                 fraction -= dy;
@@ -596,10 +1578,66 @@ void nokiaLCD::drawLine(byte x1, byte y1, byte x2, byte y2, byte c)
             y1 += stepy;
             fraction += dx;
 
-            /* Draw calculated point */
-            setPixel( x1, y1, c );
+            /* keep gathering the run of pixels in this column byte */
+            if ( x1 == lastX && y1 / 8 == row ) {
+                mask |= 1 << (y1 % 8);
+                continue;
+            }
+            applyMask( lastX, row, mask, c );
+            if ( y1 / 8 != row ) {
+                clipSpan( row, spanStart, lastX );
+                row = y1 / 8;
+                spanStart = x1;
+            }
+            mask = 1 << (y1 % 8);
         }
     }
+
+    applyMask( x1, row, mask, c );
+    clipSpan( row, spanStart, x1 );
+}
+
+
+/*
+ * Name         : applyMask
+ * Description  : Set, clear or flip the masked pixels of one buffer byte;
+ *                anything off screen is ignored
+ * Argument(s)  : x - column, row - bank
+ *                mask - the pixels to change
+ *                c - either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
+ * Return value : none
+ */
+void nokiaDisplay::applyMask(byte x, byte row, byte mask, byte c)
+{
+	if (x >= LCDCOLMAX || row >= LCDROWMAX) return;
+	byte* buf = bufferRow(row);
+	if (!buf) return;
+
+	if (c == PIXEL_ON)
+		buf[x] |= mask;
+	else if (c == PIXEL_XOR)
+		buf[x] ^= mask;
+	else
+		buf[x] &= ~mask;
+}
+
+
+/*
+ * Name         : clipSpan
+ * Description  : spanChanged() for columns given in either order, clipped to the screen
+ * Argument(s)  : row - bank
+ *                xa, xb - the two end columns
+ * Return value : none
+ */
+void nokiaDisplay::clipSpan(byte row, byte xa, byte xb)
+{
+	byte x;
+
+	if (xa > xb) { x = xa; xa = xb; xb = x; }
+	if (row >= LCDROWMAX || xa >= LCDCOLMAX) return;
+	if (xb >= LCDCOLMAX) xb = LCDCOLMAX - 1;
+
+	spanChanged(row, xa, xb);
 }
 
 
@@ -611,8 +1649,9 @@ void nokiaLCD::drawLine(byte x1, byte y1, byte x2, byte y2, byte c)
  *                c - either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
  * Return value : none
  */
-void nokiaLCD::drawRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
+void nokiaDisplay::drawRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
 {
+	nokiaTransaction transaction(*this);
 	drawLine( x1, y1, x2, y1, c );
 	drawLine( x1, y1, x1, y2, c );
 	drawLine( x1, y2, x2, y2, c );
@@ -629,10 +1668,53 @@ void nokiaLCD::drawRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
  *                c - either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
  * Return value : none
  */
-void nokiaLCD::drawFilledRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
+void nokiaDisplay::drawFilledRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
+{
+	fillArea( x1, y1, x2, y2, c );
+}
+
+
+/*
+ * Name         : fillArea
+ * Description  : Fill a rectangle of pixels a byte at a time: each bank it crosses
+ *                gets one mask (trimmed at the top and bottom edge), which is
+ *                OR'd, AND'd or XOR'd over the whole column range
+ * Argument(s)  : x1, y1 - Absolute pixel coordinates for one corner
+ *                x2, y2 - Absolute pixel coordinates for the opposite corner
+ *                c - either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
+ * Return value : none
+ */
+void nokiaDisplay::fillArea(byte x1, byte y1, byte x2, byte y2, byte c)
 {
-	for(int i=y1; i <= y2; i++ ) {
-		drawLine( x1, i, x2, i, c );
+	nokiaTransaction transaction(*this);
+	byte row, lastRow, mask, x;
+	byte *p;
+
+	if (x1 > x2) { x = x1; x1 = x2; x2 = x; }
+	if (y1 > y2) { x = y1; y1 = y2; y2 = x; }
+	if (x1 >= LCDCOLMAX || y1 >= LCDPIXELROWMAX) return;
+	if (x2 >= LCDCOLMAX) x2 = LCDCOLMAX - 1;
+	if (y2 >= LCDPIXELROWMAX) y2 = LCDPIXELROWMAX - 1;
+
+	lastRow = y2 / 8;
+	for (row = y1 / 8; row <= lastRow; row++) {
+		mask = 0xff;
+		if (row == y1 / 8) mask &= 0xff << (y1 % 8);
+		if (row == lastRow) mask &= 0xff >> (7 - y2 % 8);
+
+		p = bufferRow(row);
+		if (!p) continue; // another bank is being drawn
+		p += x1;
+		if (c == PIXEL_ON) {
+			for (x = x1; x <= x2; x++) *p++ |= mask;
+		} else if (c == PIXEL_XOR) {
+			for (x = x1; x <= x2; x++) *p++ ^= mask;
+		} else {
+			mask = ~mask;
+			for (x = x1; x <= x2; x++) *p++ &= mask;
+		}
+
+		spanChanged(row, x1, x2);
 	}
 }
 
@@ -646,8 +1728,9 @@ void nokiaLCD::drawFilledRectangle(byte x1, byte y1, byte x2, byte y2, byte c)
  * 		  c - either PIXEL_ON, PIXEL_OFF or PIXEL_XOR
  * Return value : None
  */
-void nokiaLCD::drawCircle(byte xc, byte yc, byte r, byte c)
+void nokiaDisplay::drawCircle(byte xc, byte yc, byte r, byte c)
 {
+	nokiaTransaction transaction(*this);
 	int x=0;
 	int y=r;
 	int p=3-(2*r);
@@ -673,36 +1756,540 @@ void nokiaLCD::drawCircle(byte xc, byte yc, byte r, byte c)
 		setPixel((byte)(xc-y),(byte)(yc+x), c);
 	}
 }
+
+
+/*
+ * Name         : blit
+ * Description  : Draw a bitmap into the screen buffer at any pixel position,
+ *                combined with what is already there. The bitmap is in the
+ *                drawBitmap() layout; the image is shifted across two banks
+ *                when y is not a multiple of 8. Anything off screen is clipped.
+ * Argument(s)  : x, y - Position of the top left pixel, may be off screen
+ *                map - pointer to data
+ *                size_x,size_y - Size of the image in pixels, any height
+ *                op - BLIT_COPY, BLIT_OR, BLIT_AND or BLIT_XOR
+ *                mask - optional, same layout as map: only the pixels set
+ *                in it are drawn, the rest leave the screen as it was
+ * Return value : none
+ */
+void nokiaDisplay::blit(int x, int y, const byte *map, byte size_x, byte size_y, byte op, const byte *mask)
+{
+	blitArea(x, y, map, mask, size_x, size_y, op, false);
+	areaChanged(x, y, size_x, size_y);
+}
+
+/*
+ * Name         : blitP
+ * Description  : blit() for a bitmap and mask stored in progmem/flash
+ * Argument(s)  : as blit()
+ * Return value : none
+ */
+void nokiaDisplay::blitP(int x, int y, const prog_char *map, byte size_x, byte size_y, byte op, const prog_char *mask)
+{
+	blitArea(x, y, (const byte*)map, (const byte*)mask, size_x, size_y, op, true);
+	areaChanged(x, y, size_x, size_y);
+}
+
+// combine the masked pixels of src into one buffer byte
+static inline void blitByte(byte* dst, byte src, byte mask, byte op)
+{
+	if (op == BLIT_OR)
+		*dst |= src & mask;
+	else if (op == BLIT_AND)
+		*dst &= src | ~mask;
+	else if (op == BLIT_XOR)
+		*dst ^= src & mask;
+	else
+		*dst = (*dst & ~mask) | (src & mask);
+}
+
+void nokiaDisplay::blitArea(int x, int y, const byte *map, const byte *mask, byte size_x, byte size_y,
+                        byte op, bool progmem)
+{
+	int i, first, last, top, bank;
+	byte n, shift, trim, src, m;
+	byte *lo, *hi;
+
+	// clip once - the columns on screen, and nothing if no row is
+	first = (x < 0) ? -x : 0;
+	last = (x + size_x > LCDCOLMAX) ? LCDCOLMAX - x : size_x;
+	if (first >= last || size_y == 0 || y >= LCDPIXELROWMAX || y + size_y <= 0) return;
+
+	top = (y >= 0) ? y / 8 : (y - 7) / 8; // bank of the first image row, rounded down
+	shift = y - top * 8;
+
+	for (n = 0; n < (size_y + 7) / 8; n++) {
+		bank = top + n;
+		if (bank >= LCDROWMAX) break;
+		lo = (bank >= 0) ? bufferRow(bank) : 0;
+		hi = (shift && bank + 1 >= 0 && bank + 1 < LCDROWMAX) ? bufferRow(bank + 1) : 0;
+		if (!lo && !hi) continue;
+
+		// the last bank of an image that isn't a multiple of 8 high is only partly used
+		trim = (n == (size_y - 1) / 8 && size_y % 8) ? 0xff >> (8 - size_y % 8) : 0xff;
+		for (i = first; i < last; i++) {
+			src = progmem ? pgm_read_byte(map + n * size_x + i) : map[n * size_x + i];
+			m = trim;
+			if (mask)
+				m &= progmem ? pgm_read_byte(mask + n * size_x + i) : mask[n * size_x + i];
+
+			if (lo)
+				blitByte(lo + x + i, src << shift, m << shift, op);
+			if (hi)
+				blitByte(hi + x + i, src >> (8 - shift), m >> (8 - shift), op);
+		}
+	}
+
+}
+
+/*
+ * Name         : areaChanged
+ * Description  : spanChanged() for every bank a rectangle crosses, clipped to the screen
+ * Argument(s)  : x, y - top left pixel, may be off screen
+ *                w, h - size in pixels
+ * Return value : none
+ */
+void nokiaDisplay::areaChanged(int x, int y, int w, int h)
+{
+	nokiaTransaction transaction(*this);
+	int bank, lastBank;
+
+	if (x < 0) { w += x; x = 0; }
+	if (x + w > LCDCOLMAX) w = LCDCOLMAX - x;
+	if (y < 0) { h += y; y = 0; }
+	if (w <= 0 || h <= 0 || y >= LCDPIXELROWMAX) return;
+
+	lastBank = (y + h - 1) / 8;
+	if (lastBank >= LCDROWMAX) lastBank = LCDROWMAX - 1;
+	for (bank = y / 8; bank <= lastBank; bank++)
+		spanChanged(bank, x, x + w - 1);
+}
+
+/*
+ * Name         : drawText
+ * Description  : Draw a string in the current font at any pixel position, combined
+ *                with the screen like blit(). Glyphs go into the screen buffer -
+ *                shifted across two banks unless y is a multiple of 8 - and each
+ *                bank of the string is then sent in one piece. The blank column
+ *                after each char is left as it was; setTextScale() and
+ *                setTextMode() are not used.
+ * Argument(s)  : x, y - Position of the top left pixel, may be off screen
+ *                text - string to draw
+ *                op - BLIT_COPY, BLIT_OR, BLIT_AND or BLIT_XOR
+ * Return value : the x position after the text
+ */
+int nokiaDisplay::drawText(int x, int y, const char *text, byte op)
+{
+	nokiaTransaction transaction(*this);
+	int start = x;
+	byte width;
+	byte height = mPropFont ? pgm_read_byte(mPropFont) : 8;
+	const unsigned char* columns;
+
+	while (*text) {
+		columns = glyph(*text++, width);
+		if (x >= LCDCOLMAX) break;
+		if (width)
+			blitArea(x, y, columns, 0, width, height, op, true);
+		x += width + 1;
+	}
+	areaChanged(start, y, x - start, height);
+	return x;
+}
+
+#ifndef USE_PAGED_BUFFER
+/*
+ * Name         : scroll
+ * Description  : Move the whole screen by dx, dy pixels. What goes off the edge is
+ *                lost and the space left behind is cleared. Whole banks are moved
+ *                with memmove() and the rest of dy is shifted down (or up) each
+ *                column, carrying the bits that cross into the next bank. Only the
+ *                columns of each bank that come out different are sent - or in
+ *                deferred mode marked for the next update(). The text cursor is
+ *                left where it was.
+ * Argument(s)  : dx - pixels to the right, negative for left
+ *                dy - pixels down, negative for up - scroll(0, -8) for a line of text
+ * Return value : none
+ */
+void nokiaDisplay::scroll(int dx, int dy)
+{
+	nokiaTransaction transaction(*this);
+	byte row, x, n, b, data, carry;
+	int from;
+
+	if (dx < -LCDCOLMAX) dx = -LCDCOLMAX;
+	if (dx > LCDCOLMAX) dx = LCDCOLMAX;
+	if (dy < -LCDROWMAX * 8) dy = -LCDROWMAX * 8;
+	if (dy > LCDROWMAX * 8) dy = LCDROWMAX * 8;
+
+	// sideways - each bank on its own
+	n = (dx < 0) ? -dx : dx;
+	for (row = 0; n && row < LCDROWMAX; row++) {
+		byte *p = mBuffer[row];
+		for (x = 0; x < LCDCOLMAX; x++) {
+			from = x - dx;
+			data = (from >= 0 && from < LCDCOLMAX) ? p[from] : 0;
+			if (data != p[x]) markDirty(row, x, x);
+		}
+		if (dx > 0) {
+			memmove(p + n, p, LCDCOLMAX - n);
+			memset(p, 0, n);
+		} else {
+			memmove(p, p + n, LCDCOLMAX - n);
+			memset(p + LCDCOLMAX - n, 0, n);
+		}
+	}
+
+	// whole banks - the buffer is bank after bank, so it is a single move
+	n = ((dy < 0) ? -dy : dy) / 8;
+	if (n) {
+		for (row = 0; row < LCDROWMAX; row++) {
+			from = (dy > 0) ? row - n : row + n;
+			for (x = 0; x < LCDCOLMAX; x++) {
+				data = (from >= 0 && from < LCDROWMAX) ? mBuffer[from][x] : 0;
+				if (data != mBuffer[row][x]) markDirty(row, x, x);
+			}
+		}
+		if (dy > 0) {
+			memmove(mBuffer[n], mBuffer[0], (LCDROWMAX - n) * LCDCOLMAX);
+			memset(mBuffer[0], 0, n * LCDCOLMAX);
+		} else {
+			memmove(mBuffer[0], mBuffer[n], (LCDROWMAX - n) * LCDCOLMAX);
+			memset(mBuffer[LCDROWMAX - n], 0, n * LCDCOLMAX);
+		}
+	}
+
+	// what is left - bit 0 is the top, so down is a shift left
+	n = ((dy < 0) ? -dy : dy) % 8;
+	for (x = 0; n && x < LCDCOLMAX; x++) {
+		carry = 0;
+		for (b = 0; b < LCDROWMAX; b++) {
+			row = (dy > 0) ? b : LCDROWMAX - 1 - b;
+			data = mBuffer[row][x];
+			if (dy > 0) {
+				mBuffer[row][x] = (data << n) | carry;
+				carry = data >> (8 - n);
+			} else {
+				mBuffer[row][x] = (data >> n) | carry;
+				carry = data << (8 - n);
+			}
+			if (mBuffer[row][x] != data) markDirty(row, x, x);
+		}
+	}
+
+	if (isDeferred())
+		return;
+	row = mCursorRow;
+	x = mCursorCol;
+	sendDirty();
+	gotoXY(x, row);
+}
+
+/*
+ * Name         : setTerminalMode
+ * Description  : In terminal mode a line feed on the last line of text scrolls the
+ *                screen up - see scroll() - instead of going past the bottom,
+ *                where the next char would start again at the top
+ * Argument(s)  : scrollOn - true for terminal mode
+ * Return value : none
+ */
+void nokiaDisplay::setTerminalMode(boolean scrollOn)
+{
+	mTerminal = scrollOn;
+}
+#endif
+
+
+#ifdef USE_SPRITES
+// ******************** sprites ************************************************
+
+// nokiaSprite flags
+#define SPRITE_VISIBLE 0x01
+#define SPRITE_CHANGED 0x02 // since the last updateSprites()
+
+/*
+ * Name         : spriteBank
+ * Description  : A byte of a sprite's map or mask - 0 outside the sprite, and the
+ *                rows under the last one cleared
+ * Argument(s)  : s - the sprite
+ *                p - its map or mask, 0 for a mask of all ones
+ *                i - column in the sprite
+ *                bank - bank of the sprite, may be outside it
+ * Return value : the byte
+ */
+static byte spriteBank(const nokiaSprite& s, const prog_char *p, byte i, int bank)
+{
+	if (bank < 0 || bank >= (s.sizeY + 7) / 8)
+		return 0;
+	byte data = p ? pgm_read_byte(p + bank * s.sizeX + i) : 0xff;
+	if (bank == (s.sizeY - 1) / 8 && s.sizeY % 8)
+		data &= 0xff >> (8 - s.sizeY % 8);
+	return data;
+}
+
+// 8 rows of a sprite column, from row dy of the sprite down - like blitArea()
+// the bits span two banks of the sprite unless dy is a multiple of 8
+static byte spriteBits(const nokiaSprite& s, const prog_char *p, byte i, int dy)
+{
+	int bank = (dy >= 0) ? dy / 8 : (dy - 7) / 8; // rounded down
+	byte shift = dy - bank * 8;
+	byte data = spriteBank(s, p, i, bank) >> shift;
+	if (shift)
+		data |= spriteBank(s, p, i, bank + 1) << (8 - shift);
+	return data;
+}
+
+/*
+ * Name         : screenByte
+ * Description  : What the display should show for a byte of the screen buffer -
+ *                the buffer with the visible sprites drawn over it in order
+ * Argument(s)  : row - bank 0-5
+ *                x - column
+ * Return value : the byte to send
+ */
+byte nokiaDisplay::screenByte(byte row, byte x)
+{
+	byte data = mBuffer[row][x];
+	int i, dy;
+	byte mask;
+
+	for (byte n = 0; n < LCD_MAX_SPRITES; n++) {
+		const nokiaSprite& s = mSprites[n];
+		if (!(s.flags & SPRITE_VISIBLE)) continue;
+		i = x - s.x;
+		dy = row * 8 - s.y;
+		if (i < 0 || i >= s.sizeX || dy <= -8 || dy >= s.sizeY) continue;
+
+		mask = spriteBits(s, s.mask, i, dy);
+		data = (data & ~mask) | (spriteBits(s, s.map, i, dy) & mask);
+	}
+	return data;
+}
+
+/*
+ * Name         : setSpriteP
+ * Description  : Give a sprite its bitmap - e.g. the next frame of an animation.
+ *                Shown or hidden as before.
+ * Argument(s)  : n - sprite 0 to LCD_MAX_SPRITES-1
+ *                map - bitmap in progmem, as for drawBitmapP()
+ *                mask - which pixels of the map are drawn, same layout; 0 for all
+ *                size_x, size_y - size in pixels
+ * Return value : none
+ */
+void nokiaDisplay::setSpriteP(byte n, const prog_char *map, const prog_char *mask, byte size_x, byte size_y)
+{
+	if (n >= LCD_MAX_SPRITES) return;
+	nokiaSprite& s = mSpritesNext[n];
+	s.map = map;
+	s.mask = mask;
+	s.sizeX = size_x;
+	s.sizeY = size_y;
+	s.flags |= SPRITE_CHANGED;
+}
+
+void nokiaDisplay::moveSprite(byte n, int x, int y)
+{
+	if (n >= LCD_MAX_SPRITES) return;
+	nokiaSprite& s = mSpritesNext[n];
+	if ((s.flags & SPRITE_VISIBLE) && s.x == x && s.y == y) return;
+	s.x = x;
+	s.y = y;
+	s.flags |= SPRITE_VISIBLE | SPRITE_CHANGED;
+}
+
+void nokiaDisplay::hideSprite(byte n)
+{
+	if (n >= LCD_MAX_SPRITES || !(mSpritesNext[n].flags & SPRITE_VISIBLE)) return;
+	mSpritesNext[n].flags = (mSpritesNext[n].flags & ~SPRITE_VISIBLE) | SPRITE_CHANGED;
+}
+
+/*
+ * Name         : updateSprites
+ * Description  : Show the changes to the sprites. For each sprite that changed, the
+ *                box it was in and the box it is in now are recomposited from the
+ *                screen buffer and the sprites - as one box if they overlap, e.g. a
+ *                small move, otherwise each on its own. In deferred mode they are only
+ *                marked for the next update().
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::updateSprites()
+{
+	nokiaTransaction transaction(*this);
+	int x, y, right, bottom;
+
+	for (byte n = 0; n < LCD_MAX_SPRITES; n++) {
+		nokiaSprite& next = mSpritesNext[n];
+		nokiaSprite& shown = mSprites[n];
+		if (!(next.flags & SPRITE_CHANGED)) continue;
+		next.flags &= ~SPRITE_CHANGED;
+
+		bool was = shown.flags & SPRITE_VISIBLE;
+		bool is = next.flags & SPRITE_VISIBLE;
+		x = shown.x;
+		y = shown.y;
+		right = shown.x + shown.sizeX;
+		bottom = shown.y + shown.sizeY;
+		shown = next;
+
+		if (was && is && x <= next.x + next.sizeX && next.x <= right && y <= next.y + next.sizeY && next.y <= bottom) {
+			if (next.x < x) x = next.x;
+			if (next.y < y) y = next.y;
+			if (next.x + next.sizeX > right) right = next.x + next.sizeX;
+			if (next.y + next.sizeY > bottom) bottom = next.y + next.sizeY;
+			areaChanged(x, y, right - x, bottom - y);
+			continue;
+		}
+		if (was)
+			areaChanged(x, y, right - x, bottom - y);
+		if (is)
+			areaChanged(next.x, next.y, next.sizeX, next.sizeY);
+	}
+}
+#endif
+#endif
+
+
+#ifdef USE_STATS
+// ******************** instrumentation ************************************************
+
+/*
+ * Name         : resetStats
+ * Description  : Zero the counters and the update timings
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::resetStats()
+{
+  memset(&mStats, 0, sizeof(mStats));
+  mStats.flushMin = 0xffffffffUL;
+}
+
+/*
+ * Name         : printStats
+ * Description  : Print the counters - to Serial, or to the display itself
+ * Argument(s)  : out - where to print
+ * Return value : none
+ */
+void nokiaDisplay::printStats(Print& out)
+{
+  unsigned long updates = mStats.fullUpdates + mStats.partialUpdates;
+
+  out.print("cmd ");
+  out.println(mStats.commandBytes);
+  out.print("data ");
+  out.println(mStats.dataBytes);
+  out.print("gotoXY ");
+  out.println(mStats.gotoXYs);
+  out.print("upd ");
+  out.print(mStats.fullUpdates);
+  out.print("/");
+  out.println(mStats.partialUpdates);
+  out.print("us ");
+  out.print(updates ? mStats.flushMin : 0);
+  out.print("/");
+  out.print(updates ? mStats.flushTotal / updates : 0);
+  out.print("/");
+  out.println(mStats.flushMax);
+}
+
+// full if every column of every bank is going out
+void nokiaDisplay::countUpdate()
+{
+#if defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
+  for (byte i = 0; i < LCDROWMAX; i++) {
+    if (mDirtyMin[i] != 0 || mDirtyMax[i] != LCDCOLMAX - 1) {
+      mStats.partialUpdates++;
+      return;
+    }
+  }
+#endif
+  mStats.fullUpdates++;
+}
+
+void nokiaDisplay::recordFlush(unsigned long us)
+{
+  if (us < mStats.flushMin) mStats.flushMin = us;
+  if (us > mStats.flushMax) mStats.flushMax = us;
+  mStats.flushTotal += us;
+}
 #endif
 
 
 // ******************** low level funcs ************************************************
 
 
-void nokiaLCD::writeCommand(byte data) {
+void nokiaDisplay::writeCommand(byte data) {
   send_byte(LCD_CMD, data);
+
+  // follow the controller's address counter
+  nokiaController::trackCommand(data, mAddrX, mAddrY, mControllerState);
 }
 
-void nokiaLCD::writeData(byte data) {
+void nokiaDisplay::writeData(byte data) {
   send_byte(LCD_DATA, data);
+  advanceAddress();
 }
 
-void nokiaLCD::send_byte(byte dc, byte data) {
-  digitalWrite(mPin_sce, LOW);
-  digitalWrite(mPin_dc, dc);
+/*
+ * Name         : advanceAddress
+ * Description  : Step the shadow address counter past a data byte, the way the
+ *                controller does - e.g. on the PCD8544 x wraps at the end of the
+ *                bank into the next one, and the last bank wraps to the first
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::advanceAddress() {
+  if (mAddrX != LCD_ADDR_UNKNOWN)
+    nokiaController::advance(mAddrX, mAddrY, mControllerState);
+}
 
-  // can't uses shiftOut - it clocks high, then low instead of low then high
-  //shiftOut(mPin_sdin, mPin_sclk, MSBFIRST, data);
+void nokiaDisplay::send_byte(byte dc, byte data) {
+  if (!mSelected) {
+#ifdef USE_ASYNC_UPDATE
+    waitFlush(); // the bus belongs to the background update until it is done
+#endif
+    mTransport->select();
+    mSelected = true;
+  }
+  if (dc != mDC) {
+    mTransport->setDC(dc);
+    mDC = dc;
+  }
+  mTransport->transfer(data);
+  if (!mTransactions) {
+    mTransport->deselect();
+    mSelected = false;
+  }
 
-	for(byte i=0;i<8;i++)
-	{
-		digitalWrite(mPin_sdin, (data & 0x80));//SPI_MO = dat & 0x80;
-		data = data<<1;
-    digitalWrite(mPin_sclk, LOW);
-    digitalWrite(mPin_sclk, HIGH);
-	}
+#ifdef USE_STATS
+  if (dc == LCD_CMD)
+    mStats.commandBytes++;
+  else
+    mStats.dataBytes++;
+#endif
+}
 
-  digitalWrite(mPin_sce, HIGH);
+/*
+ * Name         : beginTransaction
+ * Description  : Hold the chip select from the next byte sent until the matching
+ *                endTransaction(), so the bytes in between only clock their bits.
+ *                Transactions nest; nothing is selected if nothing is sent.
+ *                Or use a nokiaTransaction, which ends when it goes out of scope.
+ * Argument(s)  : none
+ * Return value : none
+ */
+void nokiaDisplay::beginTransaction() {
+  mTransactions++;
+}
+
+void nokiaDisplay::endTransaction() {
+  if (mTransactions == 0)
+    return;
+  if (--mTransactions == 0 && mSelected) {
+    mTransport->deselect();
+    mSelected = false;
+  }
 }
 
 
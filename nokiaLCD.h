@@ -51,33 +51,107 @@ Updated: 11 Nov 2012 Scott Daniels
 #include <avr/pgmspace.h>
 
 #include "Print.h"
+#include "nokiaTransport.h"
+#include "nokiaController.h" // display geometry - LCD_X, LCD_Y etc.
 
 // undefine these if you are really tight on space
 #define USE_GRAPHIC
 #define USE_BITMAP
+// define this for update() to return at once and send the buffer in the background
+// needs another 504 bytes of ram for the second buffer. With nokiaHardwareSPI define
+// LCD_SPI_INTERRUPT in nokiaTransport.h as well to send it from the spi interrupt
+//#define USE_ASYNC_UPDATE
+
+// define this to keep only one bank (84 bytes) of the screen in ram instead of 504 - the
+// screen is drawn a bank at a time by renderPages(), see below
+//#define USE_PAGED_BUFFER
+
+// define this for sprites - bitmaps shown over the screen buffer without changing it,
+// see setSpriteP(). Each takes 22 bytes of ram
+//#define USE_SPRITES
+#ifndef LCD_MAX_SPRITES
+#define LCD_MAX_SPRITES 4
+#endif
+
+// define this to count the bytes sent and time the updates - see getStats()
+//#define USE_STATS
+
+#if defined(USE_ASYNC_UPDATE) && !defined(USE_GRAPHIC)
+#error USE_ASYNC_UPDATE needs USE_GRAPHIC
+#endif
+#if defined(USE_PAGED_BUFFER) && !defined(USE_GRAPHIC)
+#error USE_PAGED_BUFFER needs USE_GRAPHIC
+#endif
+#if defined(USE_PAGED_BUFFER) && defined(USE_ASYNC_UPDATE)
+#error USE_PAGED_BUFFER and USE_ASYNC_UPDATE cannot be used together
+#endif
+#if defined(USE_SPRITES) && !defined(USE_GRAPHIC)
+#error USE_SPRITES needs USE_GRAPHIC
+#endif
+#if defined(USE_SPRITES) && defined(USE_PAGED_BUFFER)
+#error USE_PAGED_BUFFER and USE_SPRITES cannot be used together
+#endif
 
 // graphic display mode
 #define PIXEL_OFF 0
 #define PIXEL_ON  1
 #define PIXEL_XOR 2
 
-#define LCD_X     84
-#define LCD_Y     48
+// drawing mode - immediate sends every change to the display as it is drawn,
+// deferred only changes the screen buffer until the next update()
+#define DRAW_IMMEDIATE 0
+#define DRAW_DEFERRED  1
 
-#define LCDCOLMAX	84
-#define LCDROWMAX	6
-#define LCDPIXELROWMAX	48
+// how blit() combines the bitmap with the screen
+#define BLIT_COPY 0
+#define BLIT_OR   1
+#define BLIT_AND  2
+#define BLIT_XOR  3
 
 
-class nokiaLCD : public Print {
+#ifdef USE_SPRITES
+struct nokiaSprite {
+  const prog_char *map; // in progmem, laid out as for drawBitmapP()
+  const prog_char *mask; // the same layout, 1 for the sprite's own pixels - 0 for all of them
+  int x; // top left pixel, may be off screen
+  int y;
+  byte sizeX;
+  byte sizeY;
+  byte flags;
+};
+#endif
+
+#ifdef USE_STATS
+struct nokiaLCDStats {
+  unsigned long commandBytes;
+  unsigned long dataBytes;
+  unsigned long gotoXYs;
+  unsigned long fullUpdates;  // update() calls that sent the whole screen
+  unsigned long partialUpdates;
+  unsigned long flushMin; // update() duration in us - min, max and total for the average
+  unsigned long flushMax;
+  unsigned long flushTotal;
+};
+#endif
+
+// the text settings, for code that draws text of its own and puts the caller's back
+struct nokiaTextStyle {
+  unsigned char* font;
+  byte fontWidth;
+  byte fontLast;
+  const unsigned char* propFont; // 0 for the fixed width font
+  byte scale;
+  bool normalMode;
+  bool wrap;
+};
+
+
+// The display, driven through a transport - e.g. nokiaHardwareSPI. nokiaLCD below is the
+// same display bit-banged on any pins, and nokiaLCD_T on pins fixed at compile time.
+class nokiaDisplay : public Print {
 public:
-  // if you don't specify an sce, tie that pin to GND
-  // If you hook up the sce to a pin, you can reuse the other four pins when not writing to the display
-  // Two methods of hookup:
-  // 4 pins - all pins are tied up, and cannot be reused
-  // 5 pins - the sce pin is tied up, but the other 4 can be reused when not writing to the display
-  // a typical hookup might be: 10(res), 11(dc), 12(sdin), 13(sclk), 7(sce), 6(led)
-  nokiaLCD(byte res, byte dc, byte sdin, byte sclk, byte sce = -1, byte led = -1);
+  // the transport must live as long as the display object
+  nokiaDisplay(nokiaTransport& transport, byte res, byte led = LCD_NO_PIN);
 
   void init(); // call in your setup func - not before!!
 
@@ -91,20 +165,31 @@ public:
   void gotoCol(byte col);
   // graphics based location - x: 0-83, y: 0-5; goto is restricted to byte jumps in rows
   void gotoXY(byte x, byte y);
+  byte cursorRow() { return mCursorRow; } // where gotoXY() and the text left the cursor
+  byte cursorCol() { return mCursorCol; }
 
 #if defined(ARDUINO) && ARDUINO >= 100
   virtual size_t write(byte character);
+  virtual size_t write(const uint8_t *buffer, size_t size); // print() of a string or number comes here
 #else
   virtual void write(byte character);
+  virtual void write(const uint8_t *buffer, size_t size);
 #endif
+  using Print::write; // write(const char*)
 
   void backlight(byte level); // 0 <= level <= 255; 0 - off, 1 - on, 2-255 dim level; must be connected to PWM pin to dim
 
 // character functions
-  void setFont(unsigned char* font, byte width);
+  void setFont(unsigned char* font, byte width, byte lastChar = 123); // fixed width, chars 32 to lastChar
+  void setPropFont(const unsigned char* font); // a proportional font in progmem, e.g. propFont from font_prop.h
+  void setTextScale(byte scale); // 1-4 times the size of the font, as far as it fits the screen
   void setTextMode(bool highlight); // true = draw hilited; false = draw normal
   void setTextWrap(boolean wrapOn);
+  nokiaTextStyle getTextStyle(); // font, scale, mode and wrap, to put back with setTextStyle()
+  void setTextStyle(const nokiaTextStyle& style);
+  void resetTextStyle(); // the fixed 5x7 font at scale 1, normal, wrapping
   void writeChar(byte ch);
+  void writeString(const char *string); // as print() - a pass per line, sent with chip select held
   void writeCR();
   void writeLF();
 
@@ -116,37 +201,111 @@ public:
 #ifdef USE_BITMAP
 	void drawBitmap(byte x,byte y,byte *map, byte size_x,byte size_y);
 	void drawBitmapP(byte x,byte y, const prog_char *map, byte size_x,byte size_y);
+	void drawBitmapRLE_P(byte x,byte y, const prog_char *map, byte size_x,byte size_y); // packbits encoded
 	void clearBitmap(byte x,byte y, byte size_x,byte size_y);
 #endif
 
 // Graphic functions
-  void update();
+  void update(); // send the changed parts of the screen buffer to the display
+  void invalidate(); // force the next update() to resend the entire screen buffer
+#if defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
+  bool updateStep(unsigned int budget); // update() for at most budget us - true when done
+#endif
+#ifdef USE_ASYNC_UPDATE
+  // update() copies the changed parts of the buffer and returns; the bytes go out from the
+  // transport's interrupt, or - for a transport without one - from calls to flushStep()
+  bool isFlushing() { return mFlushing; }
+  void waitFlush(); // block until the background update is done
+  void flushStep(); // send the next byte - call from a timer isr when the transport can't interrupt
+  void setFlushCallback(void (*callback)()); // called (from the isr) when an update is done
+#endif
+#ifdef USE_PAGED_BUFFER
+  // calls draw once per bank with only that bank in ram - everything drawn is clipped to the
+  // bank and the bank is then sent. The same scene must be drawn on every call. e.g.
+  //   void drawScene(nokiaDisplay& lcd) { lcd.drawLine(0, 0, 83, 47, PIXEL_ON); ... }
+  //   display.renderPages(drawScene);
+  void renderPages(void (*draw)(nokiaDisplay& lcd));
+#endif
 #ifdef  USE_GRAPHIC
+	void setDrawMode(byte mode); // DRAW_IMMEDIATE or DRAW_DEFERRED
 	void setPixel( byte x, byte y, byte c );
 	void drawLine(byte x1, byte y1, byte x2, byte y2, byte c);
 	void drawRectangle(byte x1, byte y1, byte x2, byte y2, byte c);
 	void drawFilledRectangle(byte x1, byte y1, byte x2, byte y2, byte c);
 	void drawCircle(byte xc, byte yc, byte r, byte c);
+	// bitmaps at any pixel position, combined with the screen - see BLIT_COPY etc.
+	void blit(int x, int y, const byte *map, byte size_x, byte size_y, byte op = BLIT_COPY, const byte *mask = 0);
+	void blitP(int x, int y, const prog_char *map, byte size_x, byte size_y, byte op = BLIT_COPY, const prog_char *mask = 0);
+	int drawText(int x, int y, const char *text, byte op = BLIT_COPY); // in the current font, at any pixel position
+#ifdef USE_SPRITES
+	// sprites 0 to LCD_MAX_SPRITES-1 are drawn over what is in the screen buffer, the higher
+	// numbers on top, and the buffer is left as the background. Changes show at the next
+	// updateSprites(), which sends only the old and new box of the sprites that changed:
+	//   display.setSpriteP(0, ship, shipMask, 16, 16);
+	//   display.moveSprite(0, x, y);
+	//   display.updateSprites();
+	void setSpriteP(byte n, const prog_char *map, const prog_char *mask, byte size_x, byte size_y);
+	void moveSprite(byte n, int x, int y); // and show it
+	void hideSprite(byte n);
+	void updateSprites();
+#endif
+#ifndef USE_PAGED_BUFFER
+	void scroll(int dx, int dy); // move the screen by pixels, e.g. scroll(0, -8) for a line up
+	void setTerminalMode(boolean scrollOn); // line feeds at the bottom scroll the screen up
+#endif
 #endif
 
 
   // low level writing of bytes
   virtual void writeData(byte);
   virtual void writeCommand(byte);
+  // hold the chip select for a run of writeData() & writeCommand() - see also nokiaTransaction
+  void beginTransaction();
+  void endTransaction();
+
+  // address commands skipped because the controller was already there - since the last call
+  unsigned int elidedCommands();
+
+#ifdef USE_STATS
+  const nokiaLCDStats& getStats() { return mStats; }
+  void resetStats();
+  void printStats(Print& out); // e.g. printStats(Serial) or printStats(display)
+#endif
+
+protected:
+  // the reset and led pins - nokiaLCD_T drives its own, fixed at compile time
+  virtual void beginPins(); // both as outputs
+  virtual void writeReset(byte level);
+  virtual void writeLed(byte level); // 0 - off, 1 - on, else pwm
 
 private:
-  void setup(byte sce, byte res, byte dc, byte sdin, byte sclk, byte led);
+  void setup();
+  void setAddress(byte x, byte y);
+  void advanceAddress();
+#if defined(USE_PAGED_BUFFER)
+  bool isDeferred() { return true; } // only renderPages() sends anything
+#elif defined(USE_GRAPHIC)
+  bool isDeferred() { return mDrawMode == DRAW_DEFERRED; }
+#else
+  bool isDeferred() { return false; }
+#endif
   virtual void send_byte(byte dc, byte data);
 
-  byte mPin_sclk;
-  byte mPin_sdin;
-  byte mPin_dc;
+  nokiaTransport* mTransport;
+
   byte mPin_reset;
-  byte mPin_sce;
   byte mPin_led;
 
+  const unsigned char* glyph(byte ch, byte& width);
+  void writeCharBanks(const unsigned char* columns, byte width);
+  size_t writeLine(const uint8_t* chars, size_t size);
+
   unsigned char* mFont;
   byte mFontWidth;
+  byte mFontLast; // last char in mFont
+  const unsigned char* mPropFont; // used instead of mFont if set
+  byte mFontBanks; // height of the font in banks
+  byte mTextScale;
   bool mNormalMode; // normal or reversed (highlighted)
   bool mWrapText;
 
@@ -154,9 +313,143 @@ private:
   byte mCursorRow; // 0-5
   byte mCursorCol; // 0-83
 
+// shadow of the controller's address counter - LCD_ADDR_UNKNOWN if not known
+  byte mAddrX;
+  byte mAddrY;
+  byte mControllerState; // see nokiaController.h - e.g. the PCD8544's H & V bits
+  unsigned int mElidedCommands;
+  byte mTransactions; // beginTransaction() depth
+  bool mSelected; // chip select is held
+  byte mDC; // D/C level last driven - LCD_ADDR_UNKNOWN if not known
+
 #ifdef USE_GRAPHIC
+  void markDirty(byte row, byte x1, byte x2);
+  void markClean(byte row);
+  void spanChanged(byte row, byte x1, byte x2);
+  void fillArea(byte x1, byte y1, byte x2, byte y2, byte c);
+  void applyMask(byte x, byte row, byte mask, byte c);
+  void clipSpan(byte row, byte xa, byte xb);
+  void areaChanged(int x, int y, int w, int h);
+  void blitArea(int x, int y, const byte *map, const byte *mask, byte size_x, byte size_y, byte op, bool progmem);
+
+#ifdef USE_PAGED_BUFFER
+  // the bank being drawn by renderPages() - NULL for all the others
+  byte* bufferRow(byte row) { return (row == mPage) ? mBuffer[0] : 0; }
+  byte screenByte(byte row, byte x) { return mBuffer[0][x]; } // only for row == mPage
+
+  byte mBuffer[1][LCDCOLMAX];
+  byte mPage; // LCD_ADDR_UNKNOWN outside renderPages()
+#else
+  byte* bufferRow(byte row) { return mBuffer[row]; }
+  void sendDirty();
+#ifdef USE_SPRITES
+  byte screenByte(byte row, byte x); // the buffer with the sprites over it
+#else
+  byte screenByte(byte row, byte x) { return mBuffer[row][x]; }
+#endif
+
   byte mBuffer[LCDROWMAX][LCDCOLMAX];
+  // span of columns per bank that differ from the display ram; min > max means the bank is clean
+  byte mDirtyMin[LCDROWMAX];
+  byte mDirtyMax[LCDROWMAX];
+  bool mTerminal; // see setTerminalMode()
+  byte mStepRow; // where updateStep() carries on
+  byte mStepCol;
+#ifdef USE_SPRITES
+  nokiaSprite mSprites[LCD_MAX_SPRITES]; // as on the display - what screenByte() draws
+  nokiaSprite mSpritesNext[LCD_MAX_SPRITES]; // as at the next updateSprites()
+#endif
+#endif
+  byte mDrawMode;
+#endif
+
+#ifdef USE_STATS
+  void countUpdate();
+  void recordFlush(unsigned long us);
+
+  nokiaLCDStats mStats;
+#ifdef USE_ASYNC_UPDATE
+  unsigned long mFlushStart;
 #endif
+#endif
+
+#ifdef USE_ASYNC_UPDATE
+  static void flushComplete(void* lcd);
+  void nextFlushByte();
+  void foregroundFlushByte();
+
+  byte mBackBuffer[LCDROWMAX][LCDCOLMAX]; // what the background update is sending
+  byte mFlushMin[LCDROWMAX];
+  byte mFlushMax[LCDROWMAX];
+  byte mFlushRow;
+  byte mFlushCol;
+  byte mFlushPhase;
+  byte mFlushCmd[3]; // address cmds for the next bank
+  byte mFlushCmdCount;
+  byte mFlushCmdIndex;
+  volatile bool mFlushing;
+  volatile bool mFlushBusy; // a foreground call is in nextFlushByte() - flushStep() does nothing
+  void (*mFlushCallback)();
+#endif
+};
+
+
+// A transaction for the life of the object - e.g.
+//   {
+//     nokiaTransaction transaction(display);
+//     for (byte i = 0; i < 84; i++) display.writeData(pattern[i]);
+//   }
+class nokiaTransaction {
+public:
+  nokiaTransaction(nokiaDisplay& lcd) : mLcd(lcd) { mLcd.beginTransaction(); }
+  ~nokiaTransaction() { mLcd.endTransaction(); }
+
+private:
+  nokiaDisplay& mLcd;
+};
+
+
+// The display bit-banged on any pins
+class nokiaLCD : public nokiaDisplay {
+public:
+  // if you don't specify an sce, tie that pin to GND
+  // If you hook up the sce to a pin, you can reuse the other four pins when not writing to the display
+  // Two methods of hookup:
+  // 4 pins - all pins are tied up, and cannot be reused
+  // 5 pins - the sce pin is tied up, but the other 4 can be reused when not writing to the display
+  // a typical hookup might be: 10(res), 11(dc), 12(sdin), 13(sclk), 7(sce), 6(led)
+  nokiaLCD(byte res, byte dc, byte sdin, byte sclk, byte sce = LCD_NO_PIN, byte led = LCD_NO_PIN)
+    : nokiaDisplay(mBitBang, res, led), mBitBang(dc, sdin, sclk, sce) {}
+
+private:
+  nokiaBitBang mBitBang;
+};
+
+
+// The same display with the pins fixed at compile time - each pin change is a single
+// instruction, and an unused sce or led pin costs nothing. Use it like nokiaLCD:
+//   nokiaLCD_T<10,11,12,13,7,6> display; // reset, dc, sdin, sclk, sce, led
+template<byte RES, byte DC, byte SDIN, byte SCLK, byte SCE = LCD_NO_PIN, byte LED = LCD_NO_PIN>
+class nokiaLCD_T : public nokiaDisplay {
+public:
+  nokiaLCD_T() : nokiaDisplay(mPins, RES, LED) {}
+
+protected:
+  virtual void beginPins() { nokiaPin<RES>::output(); nokiaPin<LED>::output(); }
+  virtual void writeReset(byte level) { if (level) nokiaPin<RES>::high(); else nokiaPin<RES>::low(); }
+  virtual void writeLed(byte level)
+  {
+    if (LED == LCD_NO_PIN)
+      return;
+    // on and off through digitalWrite() - it also stops the pwm of an earlier analogWrite()
+    if (level <= 1)
+      digitalWrite(LED, level ? HIGH : LOW);
+    else
+      analogWrite(LED, level);
+  }
+
+private:
+  nokiaFastPins<DC, SDIN, SCLK, SCE> mPins;
 };
 
 #endif // nokiaLCD_h
@@ -0,0 +1,55 @@
+/*
+ * Frame scheduler for nokiaLCD - see nokiaScheduler.h
+ */
+
+#include "nokiaScheduler.h"
+
+#if defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
+
+nokiaScheduler::nokiaScheduler(nokiaDisplay& lcd, byte fps, unsigned int budget)
+  : mLcd(lcd), mFrameStart(0), mBudget(budget), mRequested(false), mFlushing(false)
+{
+  setFrameRate(fps);
+}
+
+void nokiaScheduler::setFrameRate(byte fps)
+{
+  mFrameInterval = fps ? 1000000UL / fps : 0;
+}
+
+void nokiaScheduler::setTickBudget(unsigned int budget)
+{
+  mBudget = budget;
+}
+
+void nokiaScheduler::markDirty()
+{
+  mRequested = true;
+}
+
+/*
+ * Name         : tick
+ * Description  : Start a frame if one is wanted and the frame rate allows,
+ *                and send the next budget's worth of it
+ * Argument(s)  : none
+ * Return value : true when a frame has just been finished
+ */
+bool nokiaScheduler::tick()
+{
+  if (!mFlushing) {
+    if (!mRequested)
+      return false;
+    unsigned long now = micros();
+    if (mFrameInterval && now - mFrameStart < mFrameInterval)
+      return false;
+    mFrameStart = now;
+    mRequested = false; // what is drawn from here on goes in this frame or the next
+    mFlushing = true;
+  }
+
+  if (!mLcd.updateStep(mBudget))
+    return false;
+  mFlushing = false;
+  return true;
+}
+#endif
@@ -0,0 +1,72 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/**
+Frames for a display in DRAW_DEFERRED mode, without update() blocking
+loop(). Draw into the screen buffer as usual and call markDirty() instead
+of update(); tick() from loop() then sends the frame:
+
+  - no more than the frame rate - a frame is not started until 1/fps
+    after the last one started
+  - no more than the budget (in us) of bytes per tick(), the next tick()
+    carrying on where that one stopped - see nokiaDisplay::updateStep()
+  - markDirty() during a frame asks for one more frame after it, however
+    many times it is called
+
+so the time tick() takes is bounded by the budget plus a byte. With
+USE_ASYNC_UPDATE the bytes go out in the background and tick() only
+starts the frames.
+
+  nokiaScheduler frames(display, 20, 500); // 20 fps, 500us per tick
+  ...
+  display.drawLine(...);
+  frames.markDirty();
+  ...
+  void loop() { frames.tick(); ... }
+*/
+
+#ifndef nokiaScheduler_h
+#define nokiaScheduler_h
+
+#include "nokiaLCD.h"
+
+// needs the whole screen buffer - not there without USE_GRAPHIC or with USE_PAGED_BUFFER
+#if defined(USE_GRAPHIC) && !defined(USE_PAGED_BUFFER)
+
+
+class nokiaScheduler {
+public:
+  nokiaScheduler(nokiaDisplay& lcd, byte fps = 25, unsigned int budget = 1000);
+
+  void setFrameRate(byte fps); // 0 - no cap
+  void setTickBudget(unsigned int budget); // us per tick()
+
+  void markDirty(); // the screen buffer changed - a frame is wanted
+  bool tick(); // call from loop() - true when a frame has just finished
+  bool isFlushing() { return mFlushing; } // a frame is being sent
+
+private:
+  nokiaDisplay& mLcd;
+  unsigned long mFrameInterval; // us, 0 for no cap
+  unsigned long mFrameStart;
+  unsigned int mBudget;
+  bool mRequested; // a frame is wanted after the current one
+  bool mFlushing;
+};
+
+#endif
+#endif // nokiaScheduler_h
@@ -0,0 +1,281 @@
+/*
+ * Transports for the nokiaLCD library - see nokiaTransport.h
+ */
+
+#include "nokiaTransport.h"
+#include "nokiaLCD.h" // USE_ASYNC_UPDATE
+
+
+// ******************** bit bang ************************************************
+
+nokiaBitBang::nokiaBitBang(byte dc, byte sdin, byte sclk, byte sce)
+  : mPin_dc(dc), mPin_sdin(sdin), mPin_sclk(sclk), mPin_sce(sce)
+{}
+
+void nokiaBitBang::begin()
+{
+  pinMode(mPin_dc, OUTPUT);
+  pinMode(mPin_sdin, OUTPUT);
+  pinMode(mPin_sclk, OUTPUT);
+
+  // set the data pins high -
+  // for some reason, this must be done first before the reset sequence in order for the sce pin to be optional (gnd)
+  digitalWrite(mPin_dc, HIGH);
+  digitalWrite(mPin_sdin, HIGH); // mo
+  digitalWrite(mPin_sclk, HIGH); // sck
+  if (mPin_sce != LCD_NO_PIN) {
+    pinMode(mPin_sce, OUTPUT);
+    digitalWrite(mPin_sce, HIGH); // cs
+  }
+
+#if defined(__AVR__)
+  // digitalWrite looks these up (and checks for pwm timers) on every call - do it once
+  mPort_dc = portOutputRegister(digitalPinToPort(mPin_dc));
+  mMask_dc = digitalPinToBitMask(mPin_dc);
+  mPort_sdin = portOutputRegister(digitalPinToPort(mPin_sdin));
+  mMask_sdin = digitalPinToBitMask(mPin_sdin);
+  mPort_sclk = portOutputRegister(digitalPinToPort(mPin_sclk));
+  mMask_sclk = digitalPinToBitMask(mPin_sclk);
+  if (mPin_sce != LCD_NO_PIN) {
+    mPort_sce = portOutputRegister(digitalPinToPort(mPin_sce));
+    mMask_sce = digitalPinToBitMask(mPin_sce);
+  }
+#endif
+}
+
+#if defined(__AVR__)
+void nokiaBitBang::select()
+{
+  if (mPin_sce != LCD_NO_PIN) {
+    uint8_t oldSREG = SREG;
+    cli(); // an isr may write to the same port
+    *mPort_sce &= ~mMask_sce;
+    SREG = oldSREG;
+  }
+}
+
+void nokiaBitBang::deselect()
+{
+  if (mPin_sce != LCD_NO_PIN) {
+    uint8_t oldSREG = SREG;
+    cli();
+    *mPort_sce |= mMask_sce;
+    SREG = oldSREG;
+  }
+}
+
+void nokiaBitBang::setDC(byte dc)
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  if (dc == LOW)
+    *mPort_dc &= ~mMask_dc;
+  else
+    *mPort_dc |= mMask_dc;
+  SREG = oldSREG;
+}
+
+// one bit: data out, then clock low -> high (the display samples on the rising edge)
+#define LCD_SHIFT_BIT(bit) \
+  if (data & (bit)) *sdin |= sdinHigh; else *sdin &= sdinLow; \
+  *sclk &= sclkLow; \
+  *sclk |= sclkHigh;
+
+void nokiaBitBang::transfer(byte data)
+{
+  volatile uint8_t* sdin = mPort_sdin;
+  volatile uint8_t* sclk = mPort_sclk;
+  uint8_t sdinHigh = mMask_sdin;
+  uint8_t sdinLow = ~mMask_sdin;
+  uint8_t sclkHigh = mMask_sclk;
+  uint8_t sclkLow = ~mMask_sclk;
+
+  uint8_t oldSREG = SREG;
+  cli(); // an isr may write to the same ports
+
+  // unrolled - no loop counter or shifting of data
+  LCD_SHIFT_BIT(0x80)
+  LCD_SHIFT_BIT(0x40)
+  LCD_SHIFT_BIT(0x20)
+  LCD_SHIFT_BIT(0x10)
+  LCD_SHIFT_BIT(0x08)
+  LCD_SHIFT_BIT(0x04)
+  LCD_SHIFT_BIT(0x02)
+  LCD_SHIFT_BIT(0x01)
+
+  SREG = oldSREG;
+}
+#undef LCD_SHIFT_BIT
+
+#else // not AVR - portable but slow
+
+void nokiaBitBang::select()
+{
+  if (mPin_sce != LCD_NO_PIN)
+    digitalWrite(mPin_sce, LOW);
+}
+
+void nokiaBitBang::deselect()
+{
+  if (mPin_sce != LCD_NO_PIN)
+    digitalWrite(mPin_sce, HIGH);
+}
+
+void nokiaBitBang::setDC(byte dc)
+{
+  digitalWrite(mPin_dc, dc);
+}
+
+void nokiaBitBang::transfer(byte data)
+{
+  // can't uses shiftOut - it clocks high, then low instead of low then high
+  //shiftOut(mPin_sdin, mPin_sclk, MSBFIRST, data);
+
+	for(byte i=0;i<8;i++)
+	{
+		digitalWrite(mPin_sdin, (data & 0x80));//SPI_MO = dat & 0x80;
+		data = data<<1;
+    digitalWrite(mPin_sclk, LOW);
+    digitalWrite(mPin_sclk, HIGH);
+	}
+}
+#endif
+
+
+// ******************** hardware spi ************************************************
+
+#if defined(SPDR)
+nokiaHardwareSPI::nokiaHardwareSPI(byte dc, byte sce)
+  : mPin_dc(dc), mPin_sce(sce)
+{}
+
+void nokiaHardwareSPI::begin()
+{
+  pinMode(mPin_dc, OUTPUT);
+  digitalWrite(mPin_dc, HIGH);
+  if (mPin_sce != LCD_NO_PIN) {
+    pinMode(mPin_sce, OUTPUT);
+    digitalWrite(mPin_sce, HIGH);
+  }
+
+  // SS must be an output (and high) while SPCR is set, or the SPI drops back to slave mode
+  pinMode(SS, OUTPUT);
+  digitalWrite(SS, HIGH);
+  pinMode(MOSI, OUTPUT);
+  pinMode(SCK, OUTPUT);
+
+  // master, mode 0, msb first, fosc/4 - the PCD8544 takes up to 4MHz
+  SPCR = (1 << SPE) | (1 << MSTR);
+  SPSR &= ~(1 << SPI2X);
+}
+
+void nokiaHardwareSPI::select()
+{
+  if (mPin_sce != LCD_NO_PIN)
+    digitalWrite(mPin_sce, LOW);
+}
+
+void nokiaHardwareSPI::deselect()
+{
+  if (mPin_sce != LCD_NO_PIN)
+    digitalWrite(mPin_sce, HIGH);
+}
+
+void nokiaHardwareSPI::setDC(byte dc)
+{
+  digitalWrite(mPin_dc, dc);
+}
+
+void nokiaHardwareSPI::transfer(byte data)
+{
+  SPDR = data;
+  while (!(SPSR & (1 << SPIF))); // wait until the byte is out
+}
+
+#ifdef LCD_SPI_INTERRUPT
+nokiaHardwareSPI* nokiaHardwareSPI::sActive = 0;
+
+void nokiaHardwareSPI::startTransfer(byte data)
+{
+  sActive = this;
+  SPCR |= (1 << SPIE);
+  SPDR = data;
+}
+
+#ifdef USE_ASYNC_UPDATE // nothing starts a transfer without it - leave the vector alone
+ISR(SPI_STC_vect)
+{
+  SPCR &= ~(1 << SPIE); // blocking transfers poll SPIF themselves
+  if (nokiaHardwareSPI::sActive)
+    nokiaHardwareSPI::sActive->transferComplete(); // may start the next byte
+}
+#endif
+#endif
+#endif
+
+
+// ******************** mock ************************************************
+
+nokiaMockTransport::nokiaMockTransport()
+  : mDC(HIGH), mInterruptMode(false), mPending(false), mCapture(0), mCaptureSize(0)
+{
+  reset();
+}
+
+void nokiaMockTransport::setCapture(unsigned int* buffer, unsigned int size)
+{
+  mCapture = buffer;
+  mCaptureSize = size;
+  captured = 0;
+}
+
+void nokiaMockTransport::reset()
+{
+  commandBytes = 0;
+  dataBytes = 0;
+  selects = 0;
+  captured = 0;
+}
+
+void nokiaMockTransport::begin()
+{}
+
+void nokiaMockTransport::select()
+{
+  selects++;
+}
+
+void nokiaMockTransport::deselect()
+{}
+
+void nokiaMockTransport::setDC(byte dc)
+{
+  mDC = dc;
+}
+
+void nokiaMockTransport::transfer(byte data)
+{
+  if (mDC == LOW)
+    commandBytes++;
+  else
+    dataBytes++;
+
+  if (captured < mCaptureSize)
+    mCapture[captured++] = ((unsigned int)mDC << 8) | data;
+}
+
+void nokiaMockTransport::startTransfer(byte data)
+{
+  transfer(data);
+  if (mInterruptMode)
+    mPending = true;
+}
+
+bool nokiaMockTransport::raiseInterrupt()
+{
+  if (!mPending)
+    return false;
+  mPending = false;
+  complete();
+  return true;
+}
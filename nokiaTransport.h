@@ -0,0 +1,249 @@
+/*
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/**
+The transport moves bytes from nokiaLCD to the display controller.
+nokiaLCD only knows about chip select, the D/C line and 8 bit transfers;
+how those reach the pins is up to the transport:
+
+nokiaBitBang     - any 4 pins, bits clocked out in software (the original wiring).
+                   On AVR the pins are resolved to port registers once in begin()
+                   so each bit is a couple of instructions instead of digitalWrite
+nokiaHardwareSPI - the AVR SPI peripheral on the MOSI/SCK pins, dc & sce on any pin
+nokiaFastPins<>  - bit bang on pins fixed at compile time, so each pin change
+                   is a single sbi/cbi instruction (on the uno/nano pin map)
+nokiaMockTransport - no hardware at all, just counts and optionally captures
+                   the byte stream - for running the library on a host
+*/
+
+#ifndef nokiaTransport_h
+#define nokiaTransport_h
+
+#if defined(ARDUINO) && ARDUINO >= 100
+  #include "Arduino.h"
+#else
+  #include <WConstants.h> // wiring.h
+#endif
+
+// use for an sce or led pin that is not connected
+#define LCD_NO_PIN 0xff
+
+// define this for nokiaHardwareSPI to send background updates (USE_ASYNC_UPDATE in
+// nokiaLCD.h) from the SPI transfer complete interrupt. It takes SPI_STC_vect, so it
+// is off unless asked for - without it waitFlush() or a timer calling flushStep()
+// sends the update
+//#define LCD_SPI_INTERRUPT
+
+
+class nokiaTransport {
+public:
+  virtual void begin() = 0; // set up the pins - called from nokiaDisplay::init()
+
+  virtual void select() = 0; // sce low
+  virtual void deselect() = 0; // sce high
+  virtual void setDC(byte dc) = 0; // LOW - command, HIGH - data
+  virtual void transfer(byte data) = 0; // send 8 bits, msb first
+
+  // interrupt driven transfers - a transport that canInterrupt() starts the byte
+  // and returns, then calls complete() from its isr once the byte is out.
+  // Any other transport just sends it, and the caller steps the next byte itself.
+  virtual bool canInterrupt() { return false; }
+  virtual void startTransfer(byte data) { transfer(data); }
+  virtual void poll() {} // called while waiting for an interrupt driven transfer
+  void onComplete(void (*handler)(void*), void* context) { mHandler = handler; mContext = context; }
+
+protected:
+  nokiaTransport() : mHandler(0), mContext(0) {}
+  void complete() { if (mHandler) mHandler(mContext); }
+
+private:
+  void (*mHandler)(void*);
+  void* mContext;
+};
+
+
+class nokiaBitBang : public nokiaTransport {
+public:
+  nokiaBitBang(byte dc, byte sdin, byte sclk, byte sce = LCD_NO_PIN);
+
+  virtual void begin();
+  virtual void select();
+  virtual void deselect();
+  virtual void setDC(byte dc);
+  virtual void transfer(byte data);
+
+private:
+  byte mPin_dc;
+  byte mPin_sdin;
+  byte mPin_sclk;
+  byte mPin_sce;
+
+#if defined(__AVR__)
+  // port and bit of each pin, looked up once in begin()
+  volatile uint8_t* mPort_dc;
+  volatile uint8_t* mPort_sdin;
+  volatile uint8_t* mPort_sclk;
+  volatile uint8_t* mPort_sce;
+  uint8_t mMask_dc;
+  uint8_t mMask_sdin;
+  uint8_t mMask_sclk;
+  uint8_t mMask_sce;
+#endif
+};
+
+
+#if defined(SPDR)
+// hardware spi - sdin goes on MOSI and sclk on SCK (11 & 13 on an uno)
+class nokiaHardwareSPI : public nokiaTransport {
+public:
+  nokiaHardwareSPI(byte dc, byte sce = LCD_NO_PIN);
+
+  virtual void begin();
+  virtual void select();
+  virtual void deselect();
+  virtual void setDC(byte dc);
+  virtual void transfer(byte data);
+#ifdef LCD_SPI_INTERRUPT
+  virtual bool canInterrupt() { return true; }
+  virtual void startTransfer(byte data);
+
+  static nokiaHardwareSPI* sActive; // the transport the spi isr completes
+  void transferComplete() { complete(); }
+#endif
+
+private:
+  byte mPin_dc;
+  byte mPin_sce;
+};
+#endif
+
+
+class nokiaMockTransport : public nokiaTransport {
+public:
+  nokiaMockTransport();
+
+  // capture the byte stream: each entry is (dc << 8) | data
+  void setCapture(unsigned int* buffer, unsigned int size);
+  void reset(); // zero the counters and the capture
+
+  // simulate an interrupt driven transport - startTransfer() leaves the byte
+  // pending until raiseInterrupt() (or a wait in the library) completes it
+  void setInterruptMode(bool on) { mInterruptMode = on; }
+  bool raiseInterrupt(); // true if a pending byte was completed
+  bool pending() { return mPending; }
+  virtual bool canInterrupt() { return mInterruptMode; }
+  virtual void startTransfer(byte data);
+  virtual void poll() { raiseInterrupt(); }
+
+  virtual void begin();
+  virtual void select();
+  virtual void deselect();
+  virtual void setDC(byte dc);
+  virtual void transfer(byte data);
+
+  unsigned long commandBytes;
+  unsigned long dataBytes;
+  unsigned long selects;
+  unsigned int captured;
+
+private:
+  byte mDC;
+  bool mInterruptMode;
+  volatile bool mPending;
+  unsigned int* mCapture;
+  unsigned int mCaptureSize;
+};
+
+
+// ******************** compile time pins ************************************************
+
+#if defined(__AVR_ATmega328P__) || defined(__AVR_ATmega328__) || defined(__AVR_ATmega168__) || defined(__AVR_ATmega168P__) || defined(__AVR_ATmega88__)
+#define LCD_FAST_PINS // the pin to port map below is known
+#endif
+
+// one pin, known at compile time. LCD_NO_PIN does nothing at all
+template<byte PIN>
+struct nokiaPin {
+#ifdef LCD_FAST_PINS
+  // 0-7 PORTD, 8-13 PORTB, 14-19 (A0-A5) PORTC - constant, so these inline to sbi/cbi
+  static volatile uint8_t& port() { return (PIN < 8) ? PORTD : (PIN < 14) ? PORTB : PORTC; }
+  static volatile uint8_t& ddr() { return (PIN < 8) ? DDRD : (PIN < 14) ? DDRB : DDRC; }
+  static uint8_t mask() { return (PIN == LCD_NO_PIN) ? 0 : 1 << ((PIN < 8) ? PIN : (PIN < 14) ? PIN - 8 : PIN - 14); }
+
+  static void output() { if (PIN != LCD_NO_PIN) ddr() |= mask(); }
+  static void high() { if (PIN != LCD_NO_PIN) port() |= mask(); }
+  static void low() { if (PIN != LCD_NO_PIN) port() &= ~mask(); }
+#else
+  static void output() { if (PIN != LCD_NO_PIN) pinMode(PIN, OUTPUT); }
+  static void high() { if (PIN != LCD_NO_PIN) digitalWrite(PIN, HIGH); }
+  static void low() { if (PIN != LCD_NO_PIN) digitalWrite(PIN, LOW); }
+#endif
+};
+
+
+template<byte DC, byte SDIN, byte SCLK, byte SCE = LCD_NO_PIN>
+class nokiaFastPins : public nokiaTransport {
+public:
+  virtual void begin()
+  {
+    nokiaPin<DC>::output();
+    nokiaPin<SDIN>::output();
+    nokiaPin<SCLK>::output();
+    nokiaPin<SCE>::output();
+    nokiaPin<DC>::high();
+    nokiaPin<SDIN>::high();
+    nokiaPin<SCLK>::high();
+    nokiaPin<SCE>::high();
+  }
+
+  virtual void select() { nokiaPin<SCE>::low(); }
+  virtual void deselect() { nokiaPin<SCE>::high(); }
+
+  virtual void setDC(byte dc)
+  {
+    if (dc == LOW)
+      nokiaPin<DC>::low();
+    else
+      nokiaPin<DC>::high();
+  }
+
+  virtual void transfer(byte data)
+  {
+    bit(data & 0x80);
+    bit(data & 0x40);
+    bit(data & 0x20);
+    bit(data & 0x10);
+    bit(data & 0x08);
+    bit(data & 0x04);
+    bit(data & 0x02);
+    bit(data & 0x01);
+  }
+
+private:
+  // data out, then clock low -> high (the display samples on the rising edge)
+  static void bit(byte on)
+  {
+    if (on)
+      nokiaPin<SDIN>::high();
+    else
+      nokiaPin<SDIN>::low();
+    nokiaPin<SCLK>::low();
+    nokiaPin<SCLK>::high();
+  }
+};
+
+#endif // nokiaTransport_h
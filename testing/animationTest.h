@@ -15,3 +15,32 @@ void circle_animation()
 }
 
 
+#ifdef USE_SPRITES
+// the same ring as a sprite - each step sends only the box around the old and new position
+// 16x16, drawBitmapP() layout; the mask keeps the inside of the ring opaque
+// (char literals, as prog_char is signed)
+static const prog_char ringSprite[] PROGMEM = {
+  '\x00', '\xf0', '\x38', '\x0c', '\x06', '\x06', '\x02', '\x02', '\x02', '\x02', '\x06', '\x06', '\x0c', '\x38', '\xf0', '\x00',
+  '\x00', '\x0f', '\x1c', '\x30', '\x60', '\x60', '\x40', '\x40', '\x40', '\x40', '\x60', '\x60', '\x30', '\x1c', '\x0f', '\x00'
+};
+static const prog_char ringMask[] PROGMEM = {
+  '\x00', '\xf0', '\xf8', '\xfc', '\xfe', '\xfe', '\xfe', '\xfe', '\xfe', '\xfe', '\xfe', '\xfe', '\xfc', '\xf8', '\xf0', '\x00',
+  '\x00', '\x0f', '\x1f', '\x3f', '\x7f', '\x7f', '\x7f', '\x7f', '\x7f', '\x7f', '\x7f', '\x7f', '\x3f', '\x1f', '\x0f', '\x00'
+};
+
+void sprite_animation()
+{
+  display.gotoXY(0,2); // goto 3rd line, first column
+  display.print("Hello World!");
+
+  display.setSpriteP(0, ringSprite, ringMask, 16, 16);
+  for (int i = 32; i < 52; i++)
+  {
+    display.moveSprite(0, i, 12);
+    display.updateSprites();
+    delay(100);
+  }
+  display.hideSprite(0);
+  display.updateSprites();
+}
+#endif